@@ -0,0 +1,78 @@
+# Compiles a single shader with glslangValidator, reusing SPIR-V from CACHE_DIR when the
+# same source file was already compiled to the same preprocessed code with the same flags.
+# Preprocessing expands includes, so changing them changes the key as well.
+# Writes <OUTPUT>.d, the depfile, and <OUTPUT>.flags, the -D definitions, next to the output.
+#
+# cmake -DGLSLANG=<path> -DGLSLANG_VERSION=<hash> -DINPUT=<path> -DOUTPUT=<path>
+#   -DCACHE_DIR=<dir> -P compile_shader.cmake -- <glslangValidator flags>
+
+set(flags)
+set(flags_started OFF)
+math(EXPR last_arg "${CMAKE_ARGC} - 1")
+foreach(i RANGE ${last_arg})
+  if(flags_started)
+    if(NOT "${CMAKE_ARGV${i}}" STREQUAL "")
+      list(APPEND flags "${CMAKE_ARGV${i}}")
+    endif()
+  elseif("${CMAKE_ARGV${i}}" STREQUAL "--")
+    set(flags_started ON)
+  endif()
+endforeach()
+
+set(depfile "${OUTPUT}.d")
+
+# Preprocessor definitions go next to the SPIR-V, one per line, so that ShaderHotReloader
+# compiles every permutation with the same ones
+set(defines "")
+foreach(flag ${flags})
+  if(flag MATCHES "^-D(.+)$")
+    string(APPEND defines "${CMAKE_MATCH_1}\n")
+  endif()
+endforeach()
+file(WRITE "${OUTPUT}.flags" "${defines}")
+
+execute_process(
+  COMMAND ${GLSLANG} ${flags} -E ${INPUT}
+  OUTPUT_VARIABLE preprocessed
+  RESULT_VARIABLE preprocess_result
+  ERROR_QUIET
+)
+
+# Shaders that fail to preprocess are compiled anyway, to report the errors
+if(preprocess_result EQUAL 0)
+  # The input path is a part of the key, as the stage depends on it and the cached depfile
+  # has to list the right source
+  string(SHA256 key "${GLSLANG_VERSION}\n${INPUT}\n${flags}\n${preprocessed}")
+  set(cached "${CACHE_DIR}/${key}.spv")
+
+  if(EXISTS "${cached}" AND EXISTS "${cached}.d")
+    file(COPY_FILE "${cached}" "${OUTPUT}")
+
+    # The depfile starts with the output it was written for, which may have been another one
+    file(READ "${cached}.d" dependencies)
+    string(FIND "${dependencies}" ": " colon)
+    string(SUBSTRING "${dependencies}" ${colon} -1 dependencies)
+    file(WRITE "${depfile}" "${OUTPUT}${dependencies}")
+    return()
+  endif()
+endif()
+
+execute_process(
+  COMMAND ${GLSLANG} ${flags} ${INPUT} -o ${OUTPUT} --depfile ${depfile}
+  RESULT_VARIABLE compile_result
+)
+
+if(NOT compile_result EQUAL 0)
+  message(FATAL_ERROR "Failed to compile ${INPUT}")
+endif()
+
+if(DEFINED key)
+  # Files are copied under unique names and renamed, so that builds running in
+  # parallel never see half-written ones. The SPIR-V goes last, as it marks a hit.
+  file(MAKE_DIRECTORY "${CACHE_DIR}")
+  string(RANDOM LENGTH 8 tmp_suffix)
+  file(COPY_FILE "${depfile}" "${cached}.d.${tmp_suffix}")
+  file(RENAME "${cached}.d.${tmp_suffix}" "${cached}.d")
+  file(COPY_FILE "${OUTPUT}" "${cached}.${tmp_suffix}")
+  file(RENAME "${cached}.${tmp_suffix}" "${cached}")
+endif()
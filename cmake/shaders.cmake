@@ -13,6 +13,15 @@ define_property(TARGET PROPERTY INTERFACE_SHADER_INCLUDE_DIRECTORIES
 
 find_program(glslang_validator glslangValidator)
 
+# Compiled shaders are kept here and reused by clean builds and other branches,
+# see compile_shader.cmake. It is safe to delete the directory at any time.
+set(GRAPHICS_COURSE_SHADER_CACHE_DIR "${PROJECT_SOURCE_DIR}/.shader_cache"
+  CACHE PATH "Directory of the content-addressed SPIR-V cache")
+
+# Different compiler versions produce different SPIR-V, so they don't share cache entries
+execute_process(COMMAND ${glslang_validator} --version OUTPUT_VARIABLE glslang_version)
+string(SHA256 glslang_version_hash "${glslang_version}")
+
 # Wokrs same way as target_include_directories, i.e. PUBLIC/PRIVATE/INTERFACE are supported
 function(target_shader_include_directories tgt)
   list(POP_FRONT ${ARGN})
@@ -36,29 +45,52 @@ function(target_shader_include_directories tgt)
   endforeach(arg)
 endfunction()
 
+# Compiles GLSL shaders into <binary dir>/shaders/<name>.spv, the target gets the path
+# of the directory as <TGT>_SHADERS_ROOT. Can be called several times for one target,
+# e.g. to build several permutations of the same shader. Options go after the shaders:
+#   VARIANT <suffix>  names binaries <stem>_<suffix><ext>.spv, e.g. simple_pcf.frag.spv
+#   DEFINES <defs...> preprocessor definitions like FOO or FOO=1 for these shaders
 function(target_add_shaders tgt)
-  list(POP_FRONT ${ARGN})
+  cmake_parse_arguments(PARSE_ARGV 1 arg "" "VARIANT" "DEFINES")
 
   set(shader_binaries_dir "${CMAKE_CURRENT_BINARY_DIR}/shaders/")
 
   set(incl_dirs "$<TARGET_GENEX_EVAL:${tgt},$<TARGET_PROPERTY:${tgt},SHADER_INCLUDE_DIRECTORIES>>")
 
-  foreach(glsl_path ${ARGN})
+  set(define_flags)
+  foreach(define ${arg_DEFINES})
+    list(APPEND define_flags "-D${define}")
+  endforeach(define)
+
+  set(suffix "")
+  if(DEFINED arg_VARIANT)
+    set(suffix "_${arg_VARIANT}")
+  endif()
+
+  set(SPIRV_BINARY_FILES)
+  foreach(glsl_path ${arg_UNPARSED_ARGUMENTS})
     set(input_path "${CMAKE_CURRENT_LIST_DIR}/${glsl_path}")
-    set(output_path "${shader_binaries_dir}/$<PATH:GET_FILENAME,${glsl_path}>.spv")
+    cmake_path(GET glsl_path STEM LAST_ONLY stem)
+    cmake_path(GET glsl_path EXTENSION LAST_ONLY ext)
+    set(output_path "${shader_binaries_dir}${stem}${suffix}${ext}.spv")
     add_custom_command(
         OUTPUT ${output_path}
         COMMAND ${CMAKE_COMMAND} -E make_directory ${shader_binaries_dir}
-        COMMAND ${glslang_validator}
+        COMMAND ${CMAKE_COMMAND}
+          -DGLSLANG=${glslang_validator}
+          -DGLSLANG_VERSION=${glslang_version_hash}
+          -DINPUT=${input_path}
+          -DOUTPUT=${output_path}
+          -DCACHE_DIR=${GRAPHICS_COURSE_SHADER_CACHE_DIR}
+          -P ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/compile_shader.cmake
+          --
           "$<$<BOOL:${incl_dirs}>:-I$<JOIN:${incl_dirs},;-I>>"
           "$<$<CONFIG:Debug>:-g>"
           -V
-          ${input_path}
-          -o ${output_path}
-          --depfile "${output_path}.d"
+          ${define_flags}
         VERBATIM
         COMMAND_EXPAND_LISTS
-        DEPENDS ${input_path}
+        DEPENDS ${input_path} ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/compile_shader.cmake
         DEPFILE "${output_path}.d"
       )
     list(APPEND SPIRV_BINARY_FILES ${output_path})
@@ -66,16 +98,17 @@ function(target_add_shaders tgt)
 
   set(custom_target_name "${tgt}_shaders")
 
-  if(TARGET ${custom_target_name})
-    message(FATAL_ERROR "Sorry, you can't call target_add_shaders multiple times cuz it's unimplemented. Fell free to create a PR.")
-  else()
+  # Every call adds its binaries to the same target, which the first one creates
+  if(NOT TARGET ${custom_target_name})
     set_target_properties(${tgt} PROPERTIES
       TRANSITIVE_COMPILE_PROPERTIES "SHADER_INCLUDE_DIRECTORIES"
     )
 
-    add_custom_target(${custom_target_name} DEPENDS ${SPIRV_BINARY_FILES})
+    add_custom_target(${custom_target_name})
     add_dependencies(${tgt} ${custom_target_name})
-    add_compile_definitions(${tgt}
+    target_compile_definitions(${tgt}
       PRIVATE $<UPPER_CASE:${tgt}>_SHADERS_ROOT="${shader_binaries_dir}")
   endif()
+
+  target_sources(${custom_target_name} PRIVATE ${SPIRV_BINARY_FILES})
 endfunction()
@@ -12,8 +12,12 @@ CPMAddPackage(
     "GLFW_BULID_DOCS OFF"
 )
 
-# Cross-platform 3D graphics
-find_package(Vulkan 1.3.275 REQUIRED)
+# Cross-platform 3D graphics. shaderc compiles shaders at runtime for hot reloading,
+# it only comes with the full Vulkan SDK, so hot reload is left out when it is missing.
+find_package(Vulkan 1.3.275 REQUIRED OPTIONAL_COMPONENTS shaderc_combined)
+if (NOT Vulkan_shaderc_combined_FOUND)
+  message(STATUS "shaderc was not found, shader hot reload is disabled")
+endif ()
 
 # Dear ImGui -- easiest way to do GUI
 CPMAddPackage(
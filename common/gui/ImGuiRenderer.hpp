@@ -14,7 +14,7 @@ class ImGuiRenderer
 public:
   static void enableImGuiForWindow(GLFWwindow* window);
 
-  explicit ImGuiRenderer(vk::Format target_format);
+  explicit ImGuiRenderer(vk::Format target_format, vk::PipelineCache pipeline_cache = {});
 
   void nextFrame();
 
@@ -31,7 +31,7 @@ private:
   vk::UniqueDescriptorPool descriptorPool;
   ImGuiContext* context;
 
-  void initImGui(vk::Format target_format);
+  void initImGui(vk::Format target_format, vk::PipelineCache pipeline_cache);
   void cleanupImGui();
   void createDescriptorPool();
 };
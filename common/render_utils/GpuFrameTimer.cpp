@@ -0,0 +1,88 @@
+#include "GpuFrameTimer.hpp"
+
+#include <array>
+#include <utility>
+
+#include <etna/GlobalContext.hpp>
+
+
+GpuFrameTimer::GpuFrameTimer(std::uint32_t frames_in_flight)
+  : slotCount{frames_in_flight}
+{
+  auto& ctx = etna::get_context();
+
+  validBits =
+    ctx.getPhysicalDevice().getQueueFamilyProperties()[ctx.getQueueFamilyIdx()].timestampValidBits;
+  nanosecondsPerTick = ctx.getPhysicalDevice().getProperties().limits.timestampPeriod;
+
+  if (validBits == 0)
+    return;
+
+  queryPool = etna::unwrap_vk_result(ctx.getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2 * slotCount,
+  }));
+}
+
+void GpuFrameTimer::begin(vk::CommandBuffer cmd_buf)
+{
+  if (validBits == 0)
+    return;
+
+  // The previous frame of this slot is done on the GPU, so its results are collected here,
+  // unless they never become available, e.g. after a device loss. It is skipped then.
+  collectFinished();
+  if (nextFrame - firstPendingFrame >= slotCount)
+    firstPendingFrame = nextFrame - slotCount + 1;
+
+  const auto first = static_cast<std::uint32_t>(nextFrame % slotCount) * 2;
+  cmd_buf.resetQueryPool(queryPool.get(), first, 2);
+  cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool.get(), first);
+}
+
+void GpuFrameTimer::end(vk::CommandBuffer cmd_buf)
+{
+  if (validBits == 0)
+    return;
+
+  const auto first = static_cast<std::uint32_t>(nextFrame % slotCount) * 2;
+  cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool.get(), first + 1);
+  ++nextFrame;
+}
+
+std::vector<GpuFrameTime> GpuFrameTimer::takeResults()
+{
+  collectFinished();
+  return std::exchange(results, {});
+}
+
+void GpuFrameTimer::collectFinished()
+{
+  const vk::Device device = etna::get_context().getDevice();
+  const std::uint64_t mask =
+    validBits >= 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << validBits) - 1;
+
+  for (; firstPendingFrame < nextFrame; ++firstPendingFrame)
+  {
+    const auto first = static_cast<std::uint32_t>(firstPendingFrame % slotCount) * 2;
+
+    std::array<std::uint64_t, 2> ticks{};
+    const vk::Result result = device.getQueryPoolResults(
+      queryPool.get(),
+      first,
+      2,
+      sizeof(ticks),
+      ticks.data(),
+      sizeof(std::uint64_t),
+      vk::QueryResultFlagBits::e64);
+    if (result == vk::Result::eNotReady)
+      break;
+    ETNA_CHECK_VK_RESULT(result);
+
+    const std::uint64_t elapsed = (ticks[1] - ticks[0]) & mask;
+    results.push_back(GpuFrameTime{
+      .frame = firstPendingFrame,
+      .milliseconds = static_cast<double>(elapsed) * nanosecondsPerTick / 1e6,
+    });
+  }
+}
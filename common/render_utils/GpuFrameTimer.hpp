@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+struct GpuFrameTime
+{
+  // Index of the frame among all frames timed by the timer
+  std::uint64_t frame;
+  double milliseconds;
+};
+
+/**
+ * Measures the GPU time of whole frames with a pair of timestamp queries per frame in flight.
+ * Results only become available once the GPU is done with a frame, so they are collected
+ * when a frame slot is reused, and lag behind by the number of frames in flight.
+ */
+class GpuFrameTimer
+{
+public:
+  explicit GpuFrameTimer(std::uint32_t frames_in_flight);
+
+  GpuFrameTimer(const GpuFrameTimer&) = delete;
+  GpuFrameTimer& operator=(const GpuFrameTimer&) = delete;
+
+  // Record these at the very start and the very end of the command buffer of a frame.
+  // The GPU has to be done with the frame that used the same slot before, which is
+  // what acquiring a command buffer from etna::PerFrameCmdMgr guarantees.
+  void begin(vk::CommandBuffer cmd_buf);
+  void end(vk::CommandBuffer cmd_buf);
+
+  // Times of the frames finished so far that were not taken yet, oldest first
+  std::vector<GpuFrameTime> takeResults();
+
+private:
+  void collectFinished();
+
+private:
+  vk::UniqueQueryPool queryPool;
+  std::uint32_t slotCount;
+  // Zero if the queue doesn't support timestamps, every call does nothing then
+  std::uint32_t validBits = 0;
+  double nanosecondsPerTick = 0;
+
+  std::uint64_t nextFrame = 0;
+  std::uint64_t firstPendingFrame = 0;
+  std::vector<GpuFrameTime> results;
+};
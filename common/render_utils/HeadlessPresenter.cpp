@@ -0,0 +1,59 @@
+#include "HeadlessPresenter.hpp"
+
+#include <etna/GlobalContext.hpp>
+
+
+HeadlessPresenter::HeadlessPresenter(CreateInfo info)
+  : resolution{info.resolution}
+  , format{info.format}
+{
+  auto& ctx = etna::get_context();
+
+  for (std::uint32_t i = 0; i < info.imageCount; ++i)
+  {
+    images.push_back(ctx.createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+      .name = "headless_target",
+      .format = format,
+      // Renderers may copy into swapchain images as well, so these allow it too
+      .imageUsage = vk::ImageUsageFlagBits::eColorAttachment
+        | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+    }));
+    availableSemaphores.push_back(
+      etna::unwrap_vk_result(ctx.getDevice().createSemaphoreUnique(vk::SemaphoreCreateInfo{})));
+  }
+}
+
+HeadlessPresenter::~HeadlessPresenter()
+{
+  // Semaphores may still be used by the queue
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().waitIdle());
+}
+
+HeadlessPresenter::Target HeadlessPresenter::acquireNext()
+{
+  current = (current + 1) % images.size();
+
+  // NOTE: an empty submit is the simplest way to signal a binary semaphore from the host.
+  // The image itself is free already, as the frame that used it before is done.
+  const vk::Semaphore available = availableSemaphores[current].get();
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit(
+    {vk::SubmitInfo{.signalSemaphoreCount = 1, .pSignalSemaphores = &available}}));
+
+  return Target{
+    .image = images[current].get(),
+    .view = images[current].getView({}),
+    .available = available,
+  };
+}
+
+void HeadlessPresenter::present(vk::Semaphore rendering_done)
+{
+  // A binary semaphore has to be waited on before it is signaled again
+  const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit({vk::SubmitInfo{
+    .waitSemaphoreCount = 1,
+    .pWaitSemaphores = &rendering_done,
+    .pWaitDstStageMask = &waitStage,
+  }}));
+}
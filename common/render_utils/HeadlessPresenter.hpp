@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <etna/Image.hpp>
+#include <etna/Vulkan.hpp>
+#include <glm/glm.hpp>
+
+
+/**
+ * Stands in for etna::Window when rendering without a surface, e.g. for benchmarks
+ * on machines with only a software Vulkan implementation. Hands out the images of
+ * an offscreen ring and imitates the semaphore handshake of acquiring and presenting
+ * swapchain images, so that frames are submitted through etna::PerFrameCmdMgr
+ * exactly like they are with a window.
+ */
+class HeadlessPresenter
+{
+public:
+  struct CreateInfo
+  {
+    glm::uvec2 resolution;
+    vk::Format format = vk::Format::eB8G8R8A8Srgb;
+    // Should be at least the number of frames in flight
+    std::uint32_t imageCount = 2;
+  };
+
+  explicit HeadlessPresenter(CreateInfo info);
+  ~HeadlessPresenter();
+
+  HeadlessPresenter(const HeadlessPresenter&) = delete;
+  HeadlessPresenter& operator=(const HeadlessPresenter&) = delete;
+
+  struct Target
+  {
+    vk::Image image;
+    vk::ImageView view;
+    // Signaled right away, waited on by the submit of the frame
+    vk::Semaphore available;
+  };
+
+  Target acquireNext();
+
+  // Consumes the semaphore signaled by the submit of the frame
+  void present(vk::Semaphore rendering_done);
+
+  vk::Format getFormat() const { return format; }
+  glm::uvec2 getResolution() const { return resolution; }
+
+private:
+  glm::uvec2 resolution;
+  vk::Format format;
+
+  std::vector<etna::Image> images;
+  std::vector<vk::UniqueSemaphore> availableSemaphores;
+  std::size_t current = 0;
+};
@@ -0,0 +1,130 @@
+#include "PersistentPipelineCache.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <etna/GlobalContext.hpp>
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+
+constexpr std::uint32_t PIPELINE_CACHE_MAGIC = 0x48435050; // "PPCH"
+
+// Precedes the data of the cache in the file. The data has a header of its own, but
+// it doesn't include the driver version, and drivers aren't great at validating it.
+struct FileHeader
+{
+  std::uint32_t magic;
+  std::uint32_t vendorId;
+  std::uint32_t deviceId;
+  std::uint32_t driverVersion;
+  std::array<std::uint8_t, vk::UuidSize> pipelineCacheUuid;
+  std::uint64_t dataSize;
+};
+
+FileHeader current_device_header()
+{
+  const auto props = etna::get_context().getPhysicalDevice().getProperties();
+
+  FileHeader header{
+    .magic = PIPELINE_CACHE_MAGIC,
+    .vendorId = props.vendorID,
+    .deviceId = props.deviceID,
+    .driverVersion = props.driverVersion,
+    .pipelineCacheUuid = {},
+    .dataSize = 0,
+  };
+  std::memcpy(header.pipelineCacheUuid.data(), props.pipelineCacheUUID.data(), vk::UuidSize);
+  return header;
+}
+
+bool same_device(const FileHeader& a, const FileHeader& b)
+{
+  return a.magic == b.magic && a.vendorId == b.vendorId && a.deviceId == b.deviceId
+    && a.driverVersion == b.driverVersion && a.pipelineCacheUuid == b.pipelineCacheUuid;
+}
+
+std::vector<char> read_cache_data(const std::filesystem::path& path)
+{
+  std::ifstream file{path, std::ios::binary};
+  if (!file)
+    return {};
+
+  FileHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || !same_device(header, current_device_header()))
+  {
+    spdlog::info("Pipeline cache {} is from another device or driver, ignoring it", path.string());
+    return {};
+  }
+
+  std::vector<char> data(header.dataSize);
+  file.read(data.data(), static_cast<std::streamsize>(data.size()));
+  if (!file)
+  {
+    spdlog::warn("Pipeline cache {} is truncated, ignoring it", path.string());
+    return {};
+  }
+
+  return data;
+}
+
+} // namespace
+
+PersistentPipelineCache::PersistentPipelineCache(std::filesystem::path cache_path)
+  : path{std::move(cache_path)}
+{
+  const auto data = read_cache_data(path);
+  warm = !data.empty();
+
+  // Compare the times PipelineBuilder reports for warm and cold starts
+  if (warm)
+    spdlog::info("Pipeline cache {} loaded, {} KiB, warm start", path.string(), data.size() / 1024);
+  else
+    spdlog::info("Pipeline cache {} starts empty, cold start", path.string());
+
+  cache = etna::unwrap_vk_result(
+    etna::get_context().getDevice().createPipelineCacheUnique(vk::PipelineCacheCreateInfo{
+      .initialDataSize = data.size(),
+      .pInitialData = data.data(),
+    }));
+}
+
+PersistentPipelineCache::~PersistentPipelineCache()
+{
+  save();
+}
+
+void PersistentPipelineCache::save()
+{
+  const auto data =
+    etna::unwrap_vk_result(etna::get_context().getDevice().getPipelineCacheData(cache.get()));
+
+  auto header = current_device_header();
+  header.dataSize = data.size();
+
+  // Written to a temporary file first so that a crash never leaves a broken cache behind
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file{tmpPath, std::ios::binary};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(
+      reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file)
+    {
+      spdlog::warn("Unable to write the pipeline cache to {}", tmpPath.string());
+      return;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+    spdlog::warn("Unable to save the pipeline cache to {}: {}", path.string(), ec.message());
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <filesystem>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * A VkPipelineCache that survives restarts. It is loaded from `path` on creation and
+ * saved back on destruction. The contents are only used if they come from the same
+ * device and driver version, otherwise the cache starts empty.
+ */
+class PersistentPipelineCache
+{
+public:
+  explicit PersistentPipelineCache(std::filesystem::path path);
+  ~PersistentPipelineCache();
+
+  PersistentPipelineCache(const PersistentPipelineCache&) = delete;
+  PersistentPipelineCache& operator=(const PersistentPipelineCache&) = delete;
+
+  vk::PipelineCache get() const { return cache.get(); }
+
+  // Whether the cache was loaded from disk, i.e. pipelines should be fast to create
+  bool isWarm() const { return warm; }
+
+  void save();
+
+private:
+  std::filesystem::path path;
+  vk::UniquePipelineCache cache;
+  bool warm = false;
+};
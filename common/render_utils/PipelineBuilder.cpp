@@ -0,0 +1,261 @@
+#include "PipelineBuilder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <future>
+
+#include <etna/GlobalContext.hpp>
+#include <spdlog/spdlog.h>
+
+
+struct PipelineBuildJob
+{
+  // Compute pipelines have none
+  std::optional<PipelineBuilder::GraphicsPipelineInfo> graphics;
+  // Captured on the main thread, etna only changes them when programs are reloaded
+  std::vector<vk::PipelineShaderStageCreateInfo> stages;
+  vk::PipelineLayout layout;
+
+  std::promise<void> built;
+  std::shared_future<void> ready = built.get_future().share();
+  vk::UniquePipeline pipeline;
+};
+
+namespace
+{
+
+vk::UniquePipeline build_graphics_pipeline(vk::PipelineCache cache, const PipelineBuildJob& job)
+{
+  const auto& info = *job.graphics;
+
+  vk::VertexInputBindingDescription binding{};
+  std::vector<vk::VertexInputAttributeDescription> attributes;
+  if (info.vertexInput.has_value())
+  {
+    binding = vk::VertexInputBindingDescription{
+      .binding = 0,
+      .stride = info.vertexInput->stride,
+      .inputRate = vk::VertexInputRate::eVertex,
+    };
+    for (std::uint32_t i = 0; i < info.vertexInput->attributes.size(); ++i)
+      attributes.push_back(vk::VertexInputAttributeDescription{
+        .location = i,
+        .binding = 0,
+        .format = info.vertexInput->attributes[i].format,
+        .offset = info.vertexInput->attributes[i].offset,
+      });
+  }
+
+  const vk::PipelineVertexInputStateCreateInfo vertexInput{
+    .vertexBindingDescriptionCount = info.vertexInput.has_value() ? 1u : 0u,
+    .pVertexBindingDescriptions = &binding,
+    .vertexAttributeDescriptionCount = static_cast<std::uint32_t>(attributes.size()),
+    .pVertexAttributeDescriptions = attributes.data(),
+  };
+  const vk::PipelineInputAssemblyStateCreateInfo inputAssembly{
+    .topology = vk::PrimitiveTopology::eTriangleList,
+  };
+  const vk::PipelineViewportStateCreateInfo viewport{
+    .viewportCount = 1,
+    .scissorCount = 1,
+  };
+  const vk::PipelineMultisampleStateCreateInfo multisample{
+    .rasterizationSamples = vk::SampleCountFlagBits::e1,
+  };
+  const vk::PipelineDepthStencilStateCreateInfo depthStencil{
+    .depthTestEnable = vk::True,
+    .depthWriteEnable = vk::True,
+    .depthCompareOp = vk::CompareOp::eLessOrEqual,
+    .maxDepthBounds = 1.f,
+  };
+
+  const std::vector blendAttachments(
+    info.colorAttachmentFormats.size(),
+    vk::PipelineColorBlendAttachmentState{
+      .blendEnable = vk::False,
+      .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
+        | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+    });
+  const vk::PipelineColorBlendStateCreateInfo blending{
+    .attachmentCount = static_cast<std::uint32_t>(blendAttachments.size()),
+    .pAttachments = blendAttachments.data(),
+  };
+
+  const std::array dynamicStates{vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+  const vk::PipelineDynamicStateCreateInfo dynamicState{
+    .dynamicStateCount = static_cast<std::uint32_t>(dynamicStates.size()),
+    .pDynamicStates = dynamicStates.data(),
+  };
+
+  const vk::PipelineRenderingCreateInfo rendering{
+    .colorAttachmentCount = static_cast<std::uint32_t>(info.colorAttachmentFormats.size()),
+    .pColorAttachmentFormats = info.colorAttachmentFormats.data(),
+    .depthAttachmentFormat = info.depthAttachmentFormat,
+  };
+
+  return etna::unwrap_vk_result(etna::get_context().getDevice().createGraphicsPipelineUnique(
+    cache,
+    vk::GraphicsPipelineCreateInfo{
+      .pNext = &rendering,
+      .stageCount = static_cast<std::uint32_t>(job.stages.size()),
+      .pStages = job.stages.data(),
+      .pVertexInputState = &vertexInput,
+      .pInputAssemblyState = &inputAssembly,
+      .pViewportState = &viewport,
+      .pRasterizationState = &info.rasterizationConfig,
+      .pMultisampleState = &multisample,
+      .pDepthStencilState = &depthStencil,
+      .pColorBlendState = &blending,
+      .pDynamicState = &dynamicState,
+      .layout = job.layout,
+    }));
+}
+
+vk::UniquePipeline build_compute_pipeline(vk::PipelineCache cache, const PipelineBuildJob& job)
+{
+  ETNA_VERIFY(job.stages.size() == 1);
+
+  return etna::unwrap_vk_result(etna::get_context().getDevice().createComputePipelineUnique(
+    cache,
+    vk::ComputePipelineCreateInfo{
+      .stage = job.stages.front(),
+      .layout = job.layout,
+    }));
+}
+
+std::shared_ptr<PipelineBuildJob> make_job(std::string_view program_name)
+{
+  auto& shaderManager = etna::get_context().getShaderManager();
+  const auto programId = shaderManager.getProgram(program_name);
+
+  auto job = std::make_shared<PipelineBuildJob>();
+  job->stages = shaderManager.getShaderStages(programId);
+  job->layout = shaderManager.getProgramLayout(programId);
+  return job;
+}
+
+} // namespace
+
+AsyncPipeline::AsyncPipeline(std::shared_ptr<PipelineBuildJob> build_job)
+  : job{std::move(build_job)}
+{
+}
+
+vk::Pipeline AsyncPipeline::getVkPipeline() const
+{
+  job->ready.wait();
+  return job->pipeline.get();
+}
+
+vk::PipelineLayout AsyncPipeline::getVkPipelineLayout() const
+{
+  return job->layout;
+}
+
+bool AsyncPipeline::isReady() const
+{
+  return job->ready.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+}
+
+PipelineBuilder::PipelineBuilder(vk::PipelineCache pipeline_cache, std::uint32_t thread_count)
+  : cache{pipeline_cache}
+  , threadCount{
+      thread_count != 0 ? thread_count : std::max(std::thread::hardware_concurrency(), 1u)}
+{
+  workers.reserve(threadCount);
+  for (std::uint32_t i = 0; i < threadCount; ++i)
+    workers.emplace_back([this](std::stop_token stop) { work(stop); });
+}
+
+PipelineBuilder::~PipelineBuilder()
+{
+  // Workers are stopped by their destructors, nothing may be left half-built
+  waitIdle();
+}
+
+AsyncPipeline PipelineBuilder::buildGraphics(
+  std::string_view program_name, GraphicsPipelineInfo info)
+{
+  auto job = make_job(program_name);
+  job->graphics = std::move(info);
+  enqueue(job);
+  return AsyncPipeline{std::move(job)};
+}
+
+AsyncPipeline PipelineBuilder::buildCompute(std::string_view program_name)
+{
+  auto job = make_job(program_name);
+  enqueue(job);
+  return AsyncPipeline{std::move(job)};
+}
+
+void PipelineBuilder::enqueue(std::shared_ptr<PipelineBuildJob> job)
+{
+  {
+    std::lock_guard lock{mutex};
+    if (unfinished == 0)
+    {
+      batchSize = 0;
+      batchStart = std::chrono::steady_clock::now();
+    }
+    ++batchSize;
+    ++unfinished;
+    queue.push_back(std::move(job));
+  }
+  jobAdded.notify_one();
+}
+
+void PipelineBuilder::work(std::stop_token stop)
+{
+  while (true)
+  {
+    std::shared_ptr<PipelineBuildJob> job;
+    {
+      std::unique_lock lock{mutex};
+      if (!jobAdded.wait(lock, stop, [this]() { return !queue.empty(); }))
+        return;
+      job = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    job->pipeline = job->graphics.has_value() ? build_graphics_pipeline(cache, *job)
+                                              : build_compute_pipeline(cache, *job);
+    job->built.set_value();
+
+    std::lock_guard lock{mutex};
+    if (--unfinished == 0)
+    {
+      spdlog::info(
+        "Built {} pipelines in {:.2f} ms on {} threads",
+        batchSize,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchStart)
+          .count(),
+        threadCount);
+      allBuilt.notify_all();
+    }
+  }
+}
+
+void PipelineBuilder::waitIdle()
+{
+  std::unique_lock lock{mutex};
+  allBuilt.wait(lock, [this]() { return unfinished == 0; });
+}
+
+void PipelineBuilder::retire(AsyncPipeline pipeline)
+{
+  if (!pipeline)
+    return;
+
+  retired.push_back(RetiredPipeline{
+    .releaseFrame = frameIndex + etna::get_context().getMainWorkCount().multiBufferingCount(),
+    .pipeline = std::move(pipeline),
+  });
+}
+
+void PipelineBuilder::beginFrame()
+{
+  ++frameIndex;
+  while (!retired.empty() && retired.front().releaseFrame <= frameIndex)
+    retired.pop_front();
+}
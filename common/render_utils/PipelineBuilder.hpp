@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/VertexInput.hpp>
+
+
+struct PipelineBuildJob;
+
+/**
+ * A pipeline which is built in the background by PipelineBuilder. Copies share the
+ * pipeline, which is destroyed together with the last of them.
+ */
+class AsyncPipeline
+{
+public:
+  AsyncPipeline() = default;
+
+  // Blocks until the pipeline is built, so only call this when binding it
+  vk::Pipeline getVkPipeline() const;
+  vk::PipelineLayout getVkPipelineLayout() const;
+
+  bool isReady() const;
+  explicit operator bool() const { return job != nullptr; }
+
+private:
+  friend class PipelineBuilder;
+  explicit AsyncPipeline(std::shared_ptr<PipelineBuildJob> build_job);
+
+  std::shared_ptr<PipelineBuildJob> job;
+};
+
+/**
+ * Builds pipelines of etna shader programs on a pool of worker threads, all of them
+ * through the same pipeline cache. Renderers register pipelines ahead of their use and
+ * get handles right away, the app only waits for a pipeline if it is bound before it's
+ * built.
+ *
+ * NOTE: etna::PipelineManager creates pipelines on the calling thread and has no way to
+ * use a cache, so pipelines are created with plain Vulkan from the shader modules and
+ * the layout etna has loaded for the program. Programs must not be reloaded while
+ * builds are running, see waitIdle.
+ */
+class PipelineBuilder
+{
+public:
+  // A subset of etna::GraphicsPipeline::CreateInfo. Triangle lists without blending,
+  // the viewport and scissor are dynamic. Depth is tested and written with eLessOrEqual
+  // when there is a depth attachment.
+  struct GraphicsPipelineInfo
+  {
+    // Vertices are read from binding 0, attribute i goes to location i
+    std::optional<etna::VertexByteStreamFormatDescription> vertexInput;
+    vk::PipelineRasterizationStateCreateInfo rasterizationConfig{
+      .polygonMode = vk::PolygonMode::eFill,
+      .cullMode = vk::CullModeFlagBits::eNone,
+      .frontFace = vk::FrontFace::eCounterClockwise,
+      .lineWidth = 1.f,
+    };
+    std::vector<vk::Format> colorAttachmentFormats;
+    vk::Format depthAttachmentFormat = vk::Format::eUndefined;
+  };
+
+  // `thread_count` of 0 means one thread per core
+  explicit PipelineBuilder(vk::PipelineCache cache, std::uint32_t thread_count = 0);
+  ~PipelineBuilder();
+
+  PipelineBuilder(const PipelineBuilder&) = delete;
+  PipelineBuilder& operator=(const PipelineBuilder&) = delete;
+
+  // The program has to be created with etna::create_program beforehand
+  AsyncPipeline buildGraphics(std::string_view program_name, GraphicsPipelineInfo info);
+  AsyncPipeline buildCompute(std::string_view program_name);
+
+  // Blocks until every pipeline registered so far is built
+  void waitIdle();
+
+  // Keeps a pipeline that is being replaced alive until the frames in flight are done with it
+  void retire(AsyncPipeline pipeline);
+
+  // Destroys retired pipelines that are not used anymore. Call once per frame, after the
+  // command buffer of the frame is acquired, as only that waits for older frames.
+  void beginFrame();
+
+private:
+  void enqueue(std::shared_ptr<PipelineBuildJob> job);
+  void work(std::stop_token stop);
+
+private:
+  vk::PipelineCache cache;
+  std::uint32_t threadCount;
+
+  std::mutex mutex;
+  std::condition_variable_any jobAdded;
+  std::condition_variable allBuilt;
+  std::deque<std::shared_ptr<PipelineBuildJob>> queue;
+  // Jobs that are queued or being built
+  std::size_t unfinished = 0;
+
+  // Pipelines registered since the queue was last empty, reported once they are built
+  std::size_t batchSize = 0;
+  std::chrono::steady_clock::time_point batchStart;
+
+  struct RetiredPipeline
+  {
+    std::uint64_t releaseFrame;
+    AsyncPipeline pipeline;
+  };
+
+  std::deque<RetiredPipeline> retired;
+  std::uint64_t frameIndex = 0;
+
+  std::vector<std::jthread> workers;
+};
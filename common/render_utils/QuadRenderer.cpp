@@ -3,11 +3,10 @@
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
 #include <etna/RenderTargetStates.hpp>
-#include <etna/PipelineManager.hpp>
 #include <etna/DescriptorSet.hpp>
 
 
-QuadRenderer::QuadRenderer(CreateInfo info)
+QuadRenderer::QuadRenderer(PipelineBuilder& pipeline_builder, CreateInfo info)
 {
   rect = info.rect;
 
@@ -18,14 +17,10 @@ QuadRenderer::QuadRenderer(CreateInfo info)
       "quad_renderer",
       {RENDER_UTILS_SHADERS_ROOT "quad.vert.spv", RENDER_UTILS_SHADERS_ROOT "quad.frag.spv"});
 
-  auto& pipelineManager = etna::get_context().getPipelineManager();
-  pipeline = pipelineManager.createGraphicsPipeline(
+  pipeline = pipeline_builder.buildGraphics(
     "quad_renderer",
     {
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {info.format},
-        },
+      .colorAttachmentFormats = {info.format},
     });
 }
 
@@ -1,10 +1,11 @@
 #pragma once
 
 #include <etna/Vulkan.hpp>
-#include <etna/GraphicsPipeline.hpp>
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 
+#include "PipelineBuilder.hpp"
+
 
 /**
  * Simple class for displaying a texture on the screen for debug purposes.
@@ -18,7 +19,8 @@ public:
     vk::Rect2D rect = {};
   };
 
-  explicit QuadRenderer(CreateInfo info);
+  // The pipeline is built by `pipeline_builder` in the background
+  QuadRenderer(PipelineBuilder& pipeline_builder, CreateInfo info);
   ~QuadRenderer() {}
 
   void render(
@@ -28,8 +30,10 @@ public:
     const etna::Image& tex_to_draw,
     const etna::Sampler& sampler);
 
+  const AsyncPipeline& getPipeline() const { return pipeline; }
+
 private:
-  etna::GraphicsPipeline pipeline;
+  AsyncPipeline pipeline;
   etna::ShaderProgramId programId;
   vk::Rect2D rect{};
 
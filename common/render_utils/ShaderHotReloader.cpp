@@ -0,0 +1,377 @@
+#include "ShaderHotReloader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+#include <shaderc/shaderc.hpp>
+#include <spdlog/spdlog.h>
+
+
+static constexpr auto POLL_INTERVAL = std::chrono::milliseconds{300};
+
+static std::optional<std::string> read_text_file(const std::filesystem::path& path)
+{
+  std::ifstream file{path, std::ios::binary};
+  if (!file)
+    return std::nullopt;
+  return std::string{std::istreambuf_iterator<char>{file}, {}};
+}
+
+// Dependencies listed in a Makefile-style depfile, i.e. "target: dep1 dep2 ...",
+// with spaces in paths escaped by backslashes and lines continued by backslashes.
+static std::vector<std::filesystem::path> read_depfile(const std::filesystem::path& path)
+{
+  const auto text = read_text_file(path);
+  // NOTE: absolute paths on windows have colons in them, but never followed by a space
+  const std::size_t colon = text ? text->find(": ") : std::string::npos;
+  if (colon == std::string::npos)
+    return {};
+
+  std::vector<std::filesystem::path> dependencies;
+  std::string current;
+  for (std::size_t i = colon + 2; i < text->size(); ++i)
+  {
+    const char c = (*text)[i];
+    if (c == '\\' && i + 1 < text->size() && (*text)[i + 1] == ' ')
+      current += (*text)[++i];
+    else if (
+      c == '\\' && i + 1 < text->size()
+      && std::isspace(static_cast<unsigned char>((*text)[i + 1])))
+      continue;
+    else if (std::isspace(static_cast<unsigned char>(c)))
+    {
+      if (!current.empty())
+        dependencies.emplace_back(std::exchange(current, {}));
+    }
+    else
+      current += c;
+  }
+  if (!current.empty())
+    dependencies.emplace_back(std::move(current));
+
+  return dependencies;
+}
+
+// Definitions written by compile_shader.cmake, one per line
+static std::vector<std::string> read_defines(const std::filesystem::path& path)
+{
+  std::vector<std::string> defines;
+  std::istringstream text{read_text_file(path).value_or(std::string{})};
+  for (std::string line; std::getline(text, line);)
+    if (!line.empty())
+      defines.push_back(std::move(line));
+  return defines;
+}
+
+// SHADERS_ROOT definitions end with a slash, paths built from them might not
+static std::filesystem::path normal_directory(const std::filesystem::path& dir)
+{
+  auto result = dir.lexically_normal();
+  return result.has_filename() ? result : result.parent_path();
+}
+
+static shaderc_shader_kind shader_kind(const std::filesystem::path& source)
+{
+  const auto ext = source.extension();
+  if (ext == ".vert")
+    return shaderc_vertex_shader;
+  if (ext == ".frag")
+    return shaderc_fragment_shader;
+  if (ext == ".comp")
+    return shaderc_compute_shader;
+  if (ext == ".geom")
+    return shaderc_geometry_shader;
+  if (ext == ".tesc")
+    return shaderc_tess_control_shader;
+  if (ext == ".tese")
+    return shaderc_tess_evaluation_shader;
+  if (ext == ".task")
+    return shaderc_task_shader;
+  if (ext == ".mesh")
+    return shaderc_mesh_shader;
+  // Requires a "#pragma shader_stage(...)" in the source
+  return shaderc_glsl_infer_from_source;
+}
+
+namespace
+{
+
+// Resolves includes like glslangValidator does and remembers every included file
+class Includer : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+  explicit Includer(std::span<const std::filesystem::path> include_dirs)
+    : includeDirs{include_dirs}
+  {
+  }
+
+  shaderc_include_result* GetInclude(
+    const char* requested_source,
+    shaderc_include_type type,
+    const char* requesting_source,
+    std::size_t /*include_depth*/) override
+  {
+    std::vector<std::filesystem::path> candidates;
+    if (type == shaderc_include_type_relative)
+      candidates.push_back(std::filesystem::path{requesting_source}.parent_path());
+    candidates.insert(candidates.end(), includeDirs.begin(), includeDirs.end());
+
+    auto* data = new IncludeData;
+    for (const auto& dir : candidates)
+    {
+      const auto path = (dir / requested_source).lexically_normal();
+      if (auto content = read_text_file(path))
+      {
+        data->name = path.string();
+        data->content = std::move(*content);
+        included.push_back(path);
+        break;
+      }
+    }
+
+    // An empty name tells the compiler that the include failed, the content is the error
+    if (data->name.empty())
+      data->content = std::string{"Unable to find "} + requested_source;
+
+    data->result = shaderc_include_result{
+      .source_name = data->name.data(),
+      .source_name_length = data->name.size(),
+      .content = data->content.data(),
+      .content_length = data->content.size(),
+      .user_data = data,
+    };
+    return &data->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* result) override
+  {
+    delete static_cast<IncludeData*>(result->user_data);
+  }
+
+  std::vector<std::filesystem::path> included;
+
+private:
+  struct IncludeData
+  {
+    std::string name;
+    std::string content;
+    shaderc_include_result result;
+  };
+
+  std::span<const std::filesystem::path> includeDirs;
+};
+
+} // namespace
+
+ShaderHotReloader::ShaderHotReloader(std::span<const std::filesystem::path> spirv_dirs)
+{
+  const auto disable = [this](std::string_view reason) {
+    spdlog::warn("{}, shader hot reload is disabled", reason);
+    shaders.clear();
+    loadDirs.clear();
+    std::error_code ec;
+    std::filesystem::remove_all(copiesRoot, ec);
+    copiesRoot.clear();
+  };
+
+  // NOTE: several instances of the app may be running, each one gets copies of its own
+  std::error_code ec;
+  copiesRoot = std::filesystem::temp_directory_path(ec)
+    / ("shader_hot_reload_" + std::to_string(std::random_device{}()));
+  if (ec)
+  {
+    disable("No temporary directory for shader copies");
+    return;
+  }
+
+  for (std::size_t i = 0; i < spirv_dirs.size(); ++i)
+  {
+    const auto& dir = spirv_dirs[i];
+    const auto copyDir = copiesRoot / std::to_string(i);
+    std::filesystem::create_directories(copyDir, ec);
+    if (ec)
+    {
+      disable(fmt::format("Unable to create {}: {}", copyDir.string(), ec.message()));
+      return;
+    }
+    loadDirs.emplace_back(normal_directory(dir), copyDir);
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec))
+    {
+      if (entry.path().extension() != ".spv")
+        continue;
+
+      // Shaders without depfiles are copied as well, as they are loaded from the copy
+      const auto copyPath = copyDir / entry.path().filename();
+      std::filesystem::copy_file(
+        entry.path(), copyPath, std::filesystem::copy_options::overwrite_existing, ec);
+      if (ec)
+      {
+        disable(fmt::format("Unable to copy {}: {}", entry.path().string(), ec.message()));
+        return;
+      }
+
+      auto dependencies = read_depfile(entry.path().string() + ".d");
+      if (dependencies.empty())
+        continue;
+
+      for (const auto& dep : dependencies)
+        if (std::ranges::find(includeDirs, dep.parent_path()) == includeDirs.end())
+          includeDirs.push_back(dep.parent_path());
+
+      shaders.push_back(WatchedShader{
+        .spirvPath = copyPath,
+        .sourcePath = dependencies.front(),
+        .defines = read_defines(entry.path().string() + ".flags"),
+        .dependencies = std::move(dependencies),
+        .compiledTime = std::filesystem::last_write_time(entry.path(), ec),
+      });
+    }
+  }
+
+  if (shaders.empty())
+  {
+    disable("No shaders with depfiles found");
+    return;
+  }
+  spdlog::info("Watching {} shaders for changes", shaders.size());
+
+  watcher = std::jthread([this](std::stop_token stop) {
+    std::mutex mutex;
+    std::condition_variable_any wakeUp;
+    while (!stop.stop_requested())
+    {
+      poll();
+
+      std::unique_lock lock{mutex};
+      wakeUp.wait_for(lock, stop, POLL_INTERVAL, []() { return false; });
+    }
+  });
+}
+
+ShaderHotReloader::~ShaderHotReloader()
+{
+  // The watcher may be writing to the copies
+  watcher = {};
+
+  std::error_code ec;
+  if (!copiesRoot.empty())
+    std::filesystem::remove_all(copiesRoot, ec);
+}
+
+std::filesystem::path ShaderHotReloader::getLoadDirectory(
+  const std::filesystem::path& spirv_dir) const
+{
+  const auto dir = normal_directory(spirv_dir);
+  for (const auto& [buildDir, copyDir] : loadDirs)
+    if (buildDir == dir)
+      return copyDir;
+  return spirv_dir;
+}
+
+void ShaderHotReloader::poll()
+{
+  const bool force = forceRecompile.exchange(false);
+
+  std::vector<std::pair<std::filesystem::path, std::vector<std::uint32_t>>> results;
+  for (auto& shader : shaders)
+  {
+    // NOTE: not {}, the epoch of the file clock may be in the future, e.g. 2174 in libstdc++
+    auto newest = std::filesystem::file_time_type::min();
+    for (const auto& dep : shader.dependencies)
+    {
+      std::error_code ec;
+      // Editors may briefly remove a file while saving it, that's not a change yet
+      newest = std::max(newest, std::filesystem::last_write_time(dep, ec));
+    }
+
+    if (!force && newest <= shader.compiledTime)
+      continue;
+    shader.compiledTime = newest;
+
+    if (auto code = compile(shader))
+      results.emplace_back(shader.spirvPath, std::move(*code));
+  }
+
+  if (results.empty())
+    return;
+
+  // All shaders changed at once are swapped together, e.g. both stages of a program
+  std::lock_guard lock{spirvMutex};
+  for (const auto& [path, code] : results)
+  {
+    // Replacing the file in a single step means it's never read half-written
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    {
+      std::ofstream file{tmpPath, std::ios::binary};
+      file.write(
+        reinterpret_cast<const char*>(code.data()),
+        static_cast<std::streamsize>(code.size() * sizeof(code[0])));
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+      spdlog::error("Unable to replace {}: {}", path.string(), ec.message());
+    else
+      spdlog::info("Recompiled {}", path.filename().string());
+  }
+  recompiled = true;
+}
+
+std::optional<std::vector<std::uint32_t>> ShaderHotReloader::compile(WatchedShader& shader)
+{
+  const auto source = read_text_file(shader.sourcePath);
+  if (!source)
+  {
+    spdlog::error("Unable to read {}", shader.sourcePath.string());
+    return std::nullopt;
+  }
+
+  shaderc::CompileOptions options;
+  // Same as what glslangValidator produces for target_add_shaders
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+#ifndef NDEBUG
+  options.SetGenerateDebugInfo();
+#endif
+  for (const auto& define : shader.defines)
+  {
+    const std::size_t equals = define.find('=');
+    if (equals == std::string::npos)
+      options.AddMacroDefinition(define);
+    else
+      options.AddMacroDefinition(define.substr(0, equals), define.substr(equals + 1));
+  }
+
+  auto includer = std::make_unique<Includer>(includeDirs);
+  const auto& included = includer->included;
+  options.SetIncluder(std::move(includer));
+
+  shaderc::Compiler compiler;
+  const auto result = compiler.CompileGlslToSpv(
+    *source, shader_kind(shader.sourcePath), shader.sourcePath.string().c_str(), options);
+
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+  {
+    spdlog::error(
+      "Failed to compile {}:\n{}", shader.sourcePath.string(), result.GetErrorMessage());
+    return std::nullopt;
+  }
+
+  // Includes might have been added or removed
+  shader.dependencies = {shader.sourcePath};
+  for (const auto& path : included)
+    if (std::ranges::find(shader.dependencies, path) == shader.dependencies.end())
+      shader.dependencies.push_back(path);
+
+  return std::vector<std::uint32_t>{result.cbegin(), result.cend()};
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Recompiles GLSL shaders in-process when their sources or any of the files they
+ * include change, so that shaders can be edited while the app is running.
+ * Watches every shader compiled into the given directories by target_add_shaders:
+ * the source and the includes of each one are taken from the depfile next to its
+ * SPIR-V, and the preprocessor definitions of its permutation from the .flags file.
+ * Sources are polled and compiled on a background thread.
+ *
+ * The build output is never touched, the app loads shaders from a temporary copy of
+ * it instead, see getLoadDirectory. Recompiled SPIR-V replaces the files of the copy,
+ * so etna::reload_shaders picks up the new code.
+ */
+class ShaderHotReloader
+{
+public:
+  explicit ShaderHotReloader(std::span<const std::filesystem::path> spirv_dirs);
+  ~ShaderHotReloader();
+
+  ShaderHotReloader(const ShaderHotReloader&) = delete;
+  ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+
+  // Where to load the shaders of `spirv_dir`, one of the directories passed in, from.
+  // Returns `spirv_dir` itself if hot reload is disabled.
+  std::filesystem::path getLoadDirectory(const std::filesystem::path& spirv_dir) const;
+
+  // Recompiles every watched shader on the next poll, even if nothing changed
+  void recompileAll() { forceRecompile = true; }
+
+  // Call at a frame boundary. If shaders were recompiled since the last call, calls
+  // `reload` while no SPIR-V files are being written and returns true.
+  template <class F>
+  bool applyRecompiled(F&& reload)
+  {
+    if (!recompiled.load())
+      return false;
+
+    std::lock_guard lock{spirvMutex};
+    recompiled = false;
+    reload();
+    return true;
+  }
+
+private:
+  struct WatchedShader
+  {
+    // The copy in the load directory, the build output stays as it is
+    std::filesystem::path spirvPath;
+    std::filesystem::path sourcePath;
+    // Like FOO or FOO=1, same as the DEFINES of target_add_shaders
+    std::vector<std::string> defines;
+    // The source itself and everything it includes, directly or not
+    std::vector<std::filesystem::path> dependencies;
+    // Newest modification time of the dependencies that was compiled, or failed to
+    std::filesystem::file_time_type compiledTime;
+  };
+
+  void poll();
+  std::optional<std::vector<std::uint32_t>> compile(WatchedShader& shader);
+
+private:
+  std::vector<WatchedShader> shaders;
+  // Pairs of build output directories and their copies, all inside of copiesRoot
+  std::vector<std::pair<std::filesystem::path, std::filesystem::path>> loadDirs;
+  std::filesystem::path copiesRoot;
+  // Includes are looked up here if they aren't next to the file including them
+  std::vector<std::filesystem::path> includeDirs;
+
+  std::atomic<bool> forceRecompile = false;
+  std::atomic<bool> recompiled = false;
+  std::mutex spirvMutex;
+
+  std::jthread watcher;
+};
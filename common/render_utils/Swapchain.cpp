@@ -0,0 +1,235 @@
+#include "Swapchain.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include <etna/GlobalContext.hpp>
+
+
+namespace
+{
+
+vk::SurfaceFormatKHR choose_surface_format(vk::PhysicalDevice device, vk::SurfaceKHR surface)
+{
+  const auto formats = etna::unwrap_vk_result(device.getSurfaceFormatsKHR(surface));
+  ETNA_VERIFY(!formats.empty());
+
+  // Like HeadlessPresenter, shaders write linear colors and the hardware encodes them
+  for (const auto preferred : {vk::Format::eB8G8R8A8Srgb, vk::Format::eR8G8B8A8Srgb})
+    for (const auto& format : formats)
+      if (format.format == preferred && format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear)
+        return format;
+
+  return formats.front();
+}
+
+vk::PresentModeKHR choose_present_mode(
+  vk::PhysicalDevice device, vk::SurfaceKHR surface, bool vsync)
+{
+  // FIFO is the only mode that is always supported
+  if (vsync)
+    return vk::PresentModeKHR::eFifo;
+
+  const auto modes = etna::unwrap_vk_result(device.getSurfacePresentModesKHR(surface));
+  for (const auto preferred : {vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate})
+    if (std::ranges::find(modes, preferred) != modes.end())
+      return preferred;
+
+  return vk::PresentModeKHR::eFifo;
+}
+
+} // namespace
+
+Swapchain::Swapchain(vk::UniqueSurfaceKHR window_surface)
+  : surface{std::move(window_surface)}
+{
+  auto& ctx = etna::get_context();
+
+  ETNA_VERIFY(etna::unwrap_vk_result(
+    ctx.getPhysicalDevice().getSurfaceSupportKHR(ctx.getQueueFamilyIdx(), surface.get())));
+
+  surfaceFormat = choose_surface_format(ctx.getPhysicalDevice(), surface.get());
+
+  const std::uint32_t framesInFlight = ctx.getMainWorkCount().multiBufferingCount();
+  for (std::uint32_t i = 0; i < framesInFlight; ++i)
+    availableSemaphores.push_back(
+      etna::unwrap_vk_result(ctx.getDevice().createSemaphoreUnique(vk::SemaphoreCreateInfo{})));
+}
+
+Swapchain::~Swapchain() = default;
+
+glm::uvec2 Swapchain::recreate(const DesiredProperties& props)
+{
+  auto& ctx = etna::get_context();
+  const auto physicalDevice = ctx.getPhysicalDevice();
+  const auto device = ctx.getDevice();
+
+  const auto caps =
+    etna::unwrap_vk_result(physicalDevice.getSurfaceCapabilitiesKHR(surface.get()));
+
+  // The surface either dictates the extent or lets us choose it within its limits
+  vk::Extent2D extent = caps.currentExtent;
+  if (extent.width == std::numeric_limits<std::uint32_t>::max())
+    extent = vk::Extent2D{
+      std::clamp(props.resolution.x, caps.minImageExtent.width, caps.maxImageExtent.width),
+      std::clamp(props.resolution.y, caps.minImageExtent.height, caps.maxImageExtent.height),
+    };
+  if (extent.width == 0 || extent.height == 0)
+    return resolution;
+
+  // Debug views are copied into the images
+  const auto usage = vk::ImageUsageFlagBits::eColorAttachment
+    | vk::ImageUsageFlagBits::eTransferDst;
+  ETNA_VERIFY((caps.supportedUsageFlags & usage) == usage);
+
+  // One more than the minimum, so that acquiring never waits for the presentation engine
+  std::uint32_t imageCount = caps.minImageCount + 1;
+  if (caps.maxImageCount != 0)
+    imageCount = std::min(imageCount, caps.maxImageCount);
+
+  // Some compositors don't support opaque windows, but always support one of these
+  const std::array compositeAlphas{
+    vk::CompositeAlphaFlagBitsKHR::eOpaque,
+    vk::CompositeAlphaFlagBitsKHR::eInherit,
+    vk::CompositeAlphaFlagBitsKHR::ePreMultiplied,
+    vk::CompositeAlphaFlagBitsKHR::ePostMultiplied,
+  };
+  const auto compositeAlpha = *std::ranges::find_if(
+    compositeAlphas, [&caps](auto alpha) { return bool(caps.supportedCompositeAlpha & alpha); });
+
+  // NOTE: the old swapchain is retired by this even if it's still presenting, the frames
+  // in flight finish with their images, but no new images can be acquired from it.
+  SwapchainData data;
+  data.swapchain =
+    etna::unwrap_vk_result(device.createSwapchainKHRUnique(vk::SwapchainCreateInfoKHR{
+      .surface = surface.get(),
+      .minImageCount = imageCount,
+      .imageFormat = surfaceFormat.format,
+      .imageColorSpace = surfaceFormat.colorSpace,
+      .imageExtent = extent,
+      .imageArrayLayers = 1,
+      .imageUsage = usage,
+      .imageSharingMode = vk::SharingMode::eExclusive,
+      .preTransform = caps.currentTransform,
+      .compositeAlpha = compositeAlpha,
+      .presentMode = choose_present_mode(physicalDevice, surface.get(), props.vsync),
+      .clipped = vk::True,
+      .oldSwapchain = current.swapchain.get(),
+    }));
+
+  data.images = etna::unwrap_vk_result(device.getSwapchainImagesKHR(data.swapchain.get()));
+  for (const vk::Image image : data.images)
+    data.views.push_back(
+      etna::unwrap_vk_result(device.createImageViewUnique(vk::ImageViewCreateInfo{
+        .image = image,
+        .viewType = vk::ImageViewType::e2D,
+        .format = surfaceFormat.format,
+        .subresourceRange =
+          vk::ImageSubresourceRange{
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+          },
+      })));
+
+  if (current.swapchain)
+    retired.push_back(RetiredSwapchain{
+      .releaseFrame = frameIndex + ctx.getMainWorkCount().multiBufferingCount(),
+      .data = std::move(current),
+    });
+
+  current = std::move(data);
+  fresh.assign(current.images.size(), true);
+  resolution = {extent.width, extent.height};
+  return resolution;
+}
+
+std::optional<Swapchain::Target> Swapchain::acquireNext()
+{
+  const vk::Semaphore available = availableSemaphores[nextSemaphore].get();
+  nextSemaphore = (nextSemaphore + 1) % availableSemaphores.size();
+
+  // NOTE: the overloads returning results directly don't treat out of date as an error
+  std::uint32_t index = 0;
+  const vk::Result result = etna::get_context().getDevice().acquireNextImageKHR(
+    current.swapchain.get(), std::numeric_limits<std::uint64_t>::max(), available, {}, &index);
+
+  // A suboptimal swapchain still signals the semaphore, so the image is used
+  if (result == vk::Result::eErrorOutOfDateKHR)
+    return std::nullopt;
+  if (result != vk::Result::eSuboptimalKHR)
+    ETNA_CHECK_VK_RESULT(result);
+
+  return Target{
+    .image = current.images[index],
+    .view = current.views[index].get(),
+    .available = available,
+  };
+}
+
+void Swapchain::prepareImage(vk::CommandBuffer cmd_buf, vk::Image image)
+{
+  const auto it = std::ranges::find(current.images, image);
+  ETNA_VERIFY(it != current.images.end());
+  const auto index = static_cast<std::size_t>(it - current.images.begin());
+  if (!fresh[index])
+    return;
+  fresh[index] = false;
+
+  // Every frame leaves its image in the present layout, which is the layout etna
+  // expects to find the image in if the handle was used before. If it wasn't, etna
+  // assumes the undefined layout, and transitions from it are valid from any layout.
+  const vk::ImageMemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+    .oldLayout = vk::ImageLayout::eUndefined,
+    .newLayout = vk::ImageLayout::ePresentSrcKHR,
+    .image = image,
+    .subresourceRange =
+      vk::ImageSubresourceRange{
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      },
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers = &barrier,
+  });
+}
+
+bool Swapchain::present(vk::Semaphore rendering_done, vk::ImageView view)
+{
+  const auto it = std::ranges::find_if(
+    current.views, [view](const vk::UniqueImageView& v) { return v.get() == view; });
+  ETNA_VERIFY(it != current.views.end());
+  const auto index = static_cast<std::uint32_t>(it - current.views.begin());
+
+  const vk::SwapchainKHR swapchain = current.swapchain.get();
+  const vk::PresentInfoKHR presentInfo{
+    .waitSemaphoreCount = 1,
+    .pWaitSemaphores = &rendering_done,
+    .swapchainCount = 1,
+    .pSwapchains = &swapchain,
+    .pImageIndices = &index,
+  };
+  const vk::Result result = etna::get_context().getQueue().presentKHR(&presentInfo);
+
+  if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR)
+    return false;
+  ETNA_CHECK_VK_RESULT(result);
+  return true;
+}
+
+void Swapchain::beginFrame()
+{
+  ++frameIndex;
+  while (!retired.empty() && retired.front().releaseFrame <= frameIndex)
+    retired.pop_front();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <glm/glm.hpp>
+
+
+/**
+ * Stands in for etna::Window, whose swapchain can only be recreated once the device
+ * is idle. Here the new swapchain is created from the old one, which is retired along
+ * with its image views until the frames in flight are done with them, so resizing the
+ * window never stalls the frames that are already submitted.
+ */
+class Swapchain
+{
+public:
+  struct DesiredProperties
+  {
+    glm::uvec2 resolution;
+    bool vsync = true;
+  };
+
+  explicit Swapchain(vk::UniqueSurfaceKHR window_surface);
+  ~Swapchain();
+
+  Swapchain(const Swapchain&) = delete;
+  Swapchain& operator=(const Swapchain&) = delete;
+
+  // Returns the resolution that was actually used, the surface may dictate its own.
+  // Keeps the current swapchain while the surface has no area, e.g. when minimized.
+  glm::uvec2 recreate(const DesiredProperties& props);
+
+  struct Target
+  {
+    vk::Image image;
+    vk::ImageView view;
+    // Signaled once the image may be rendered to, waited on by the submit of the frame
+    vk::Semaphore available;
+  };
+
+  // Empty if the swapchain is out of date and has to be recreated
+  std::optional<Target> acquireNext();
+
+  // Images of a new swapchain may reuse the handles of destroyed ones, whose layouts etna
+  // still remembers. Record this before anything else uses the image in the frame.
+  void prepareImage(vk::CommandBuffer cmd_buf, vk::Image image);
+
+  // Returns false if the swapchain has to be recreated
+  bool present(vk::Semaphore rendering_done, vk::ImageView view);
+
+  // Destroys retired swapchains that are not used anymore. Call once per frame, after
+  // the command buffer of the frame is acquired, as only that waits for older frames.
+  void beginFrame();
+
+  vk::Format getCurrentFormat() const { return surfaceFormat.format; }
+
+private:
+  struct SwapchainData
+  {
+    vk::UniqueSwapchainKHR swapchain;
+    std::vector<vk::Image> images;
+    // Declared after the swapchain, so that they are destroyed before it
+    std::vector<vk::UniqueImageView> views;
+  };
+
+  struct RetiredSwapchain
+  {
+    std::uint64_t releaseFrame;
+    SwapchainData data;
+  };
+
+private:
+  vk::UniqueSurfaceKHR surface;
+  vk::SurfaceFormatKHR surfaceFormat;
+
+  SwapchainData current;
+  glm::uvec2 resolution{0, 0};
+  // Images of the current swapchain which were never prepared
+  std::vector<bool> fresh;
+
+  // One per frame in flight, a frame slot is only reused once its submit is done
+  std::vector<vk::UniqueSemaphore> availableSemaphores;
+  std::size_t nextSemaphore = 0;
+
+  std::deque<RetiredSwapchain> retired;
+  std::uint64_t frameIndex = 0;
+};
@@ -0,0 +1,263 @@
+#include "TransientImagePool.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+namespace
+{
+
+vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+std::uint32_t pick_memory_type(std::uint32_t type_bits)
+{
+  const auto props = etna::get_context().getPhysicalDevice().getMemoryProperties();
+
+  std::uint32_t fallback = props.memoryTypeCount;
+  for (std::uint32_t i = 0; i < props.memoryTypeCount; ++i)
+  {
+    if ((type_bits & (1u << i)) == 0)
+      continue;
+    if (props.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal)
+      return i;
+    fallback = std::min(fallback, i);
+  }
+
+  ETNA_VERIFY(fallback < props.memoryTypeCount);
+  return fallback;
+}
+
+void set_debug_name(vk::Image image, const std::string& name)
+{
+  // NOTE: etna only loads debug utils along with the validation layers
+  if (VULKAN_HPP_DEFAULT_DISPATCHER.vkSetDebugUtilsObjectNameEXT == nullptr)
+    return;
+
+  ETNA_CHECK_VK_RESULT(
+    etna::get_context().getDevice().setDebugUtilsObjectNameEXT(vk::DebugUtilsObjectNameInfoEXT{
+      .objectType = vk::ObjectType::eImage,
+      .objectHandle = reinterpret_cast<std::uint64_t>(static_cast<VkImage>(image)),
+      .pObjectName = name.c_str(),
+    }));
+}
+
+} // namespace
+
+void TransientImagePool::beginFrame()
+{
+  ++frameIndex;
+  while (!retiredImages.empty() && retiredImages.front().releaseFrame <= frameIndex)
+    retiredImages.pop_front();
+
+  declarations.clear();
+}
+
+TransientImagePool::ImageId TransientImagePool::declare(
+  ImageDesc desc, std::uint32_t first_pass, std::uint32_t last_pass)
+{
+  ETNA_VERIFY(first_pass <= last_pass);
+  declarations.push_back(Declaration{
+    .desc = std::move(desc),
+    .firstPass = first_pass,
+    .lastPass = last_pass,
+  });
+  return static_cast<ImageId>(declarations.size() - 1);
+}
+
+void TransientImagePool::retireImages()
+{
+  if (!memory)
+    return;
+
+  retiredImages.push_back(RetiredImages{
+    .releaseFrame = frameIndex + etna::get_context().getMainWorkCount().multiBufferingCount(),
+    .memory = std::move(memory),
+    .images = std::move(images),
+  });
+  images.clear();
+  stats = {};
+}
+
+void TransientImagePool::compile()
+{
+  // Same targets as in the last frame, e.g. nothing was resized
+  if (declarations == compiledDeclarations)
+    return;
+
+  retireImages();
+  compiledDeclarations = declarations;
+  if (declarations.empty())
+    return;
+
+  auto device = etna::get_context().getDevice();
+
+  std::vector<vk::MemoryRequirements> requirements;
+  std::uint32_t typeBits = ~0u;
+  images.reserve(declarations.size());
+  for (const auto& decl : declarations)
+  {
+    // NOTE: aliasing is only allowed for images created without any memory bound,
+    // so these can't come from etna/VMA, which always allocates memory per image.
+    vk::UniqueImage image = etna::unwrap_vk_result(device.createImageUnique(vk::ImageCreateInfo{
+      .imageType = vk::ImageType::e2D,
+      .format = decl.desc.format,
+      .extent = vk::Extent3D{decl.desc.extent.width, decl.desc.extent.height, 1},
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = vk::SampleCountFlagBits::e1,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = decl.desc.usage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .initialLayout = vk::ImageLayout::eUndefined,
+    }));
+    set_debug_name(image.get(), decl.desc.name);
+    requirements.push_back(device.getImageMemoryRequirements(image.get()));
+    typeBits &= requirements.back().memoryTypeBits;
+    images.push_back(PlacedImage{.image = std::move(image)});
+  }
+
+  // Everything lives in a single allocation, so all images need a common memory type.
+  // Transient targets are always optimally tiled and device local, so this never fails.
+  ETNA_VERIFY(typeBits != 0);
+
+  // Greedy placement, largest images first: every image goes to the lowest offset that
+  // doesn't overlap with the images that are alive at the same time as it.
+  std::vector<std::size_t> order(declarations.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&requirements](std::size_t a, std::size_t b) {
+    return requirements[a].size > requirements[b].size;
+  });
+
+  std::vector<vk::DeviceSize> offsets(declarations.size());
+  std::vector<std::size_t> placed;
+  vk::DeviceSize totalSize = 0;
+  for (const std::size_t idx : order)
+  {
+    const auto& decl = declarations[idx];
+    const auto& req = requirements[idx];
+
+    std::vector<std::size_t> conflicts;
+    for (const std::size_t other : placed)
+      if (decl.firstPass <= declarations[other].lastPass &&
+        declarations[other].firstPass <= decl.lastPass)
+        conflicts.push_back(other);
+
+    const auto fits = [&](vk::DeviceSize offset) {
+      return std::ranges::none_of(conflicts, [&](std::size_t other) {
+        return offset < offsets[other] + requirements[other].size &&
+          offsets[other] < offset + req.size;
+      });
+    };
+
+    vk::DeviceSize best = fits(0) ? 0 : ~vk::DeviceSize{0};
+    for (const std::size_t other : conflicts)
+    {
+      const vk::DeviceSize candidate =
+        align_up(offsets[other] + requirements[other].size, req.alignment);
+      if (candidate < best && fits(candidate))
+        best = candidate;
+    }
+
+    offsets[idx] = best;
+    placed.push_back(idx);
+    totalSize = std::max(totalSize, best + req.size);
+  }
+
+  memory = etna::unwrap_vk_result(device.allocateMemoryUnique(vk::MemoryAllocateInfo{
+    .allocationSize = totalSize,
+    .memoryTypeIndex = pick_memory_type(typeBits),
+  }));
+
+  stats.aliasedBytes = totalSize;
+  stats.separateBytes = 0;
+  for (std::size_t i = 0; i < declarations.size(); ++i)
+  {
+    const auto& desc = declarations[i].desc;
+    ETNA_CHECK_VK_RESULT(device.bindImageMemory(images[i].image.get(), memory.get(), offsets[i]));
+    images[i].view = etna::unwrap_vk_result(device.createImageViewUnique(vk::ImageViewCreateInfo{
+      .image = images[i].image.get(),
+      .viewType = vk::ImageViewType::e2D,
+      .format = desc.format,
+      .subresourceRange =
+        vk::ImageSubresourceRange{
+          .aspectMask = desc.aspect,
+          .baseMipLevel = 0,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+    }));
+    stats.separateBytes += requirements[i].size;
+  }
+}
+
+void TransientImagePool::beginPass(vk::CommandBuffer cmd_buf, std::uint32_t pass)
+{
+  std::vector<vk::ImageMemoryBarrier2> barriers;
+  for (std::size_t i = 0; i < compiledDeclarations.size(); ++i)
+  {
+    const auto& decl = compiledDeclarations[i];
+    if (decl.firstPass != pass)
+      continue;
+
+    // The memory may have been used by another image earlier in this frame or by
+    // the previous frame. Going from the undefined layout drops the old contents.
+    barriers.push_back(vk::ImageMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+      .srcAccessMask = vk::AccessFlagBits2::eMemoryWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+      .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+      .oldLayout = vk::ImageLayout::eUndefined,
+      .newLayout = decl.desc.firstLayout,
+      .image = images[i].image.get(),
+      .subresourceRange =
+        vk::ImageSubresourceRange{
+          .aspectMask = decl.desc.aspect,
+          .baseMipLevel = 0,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+    });
+  }
+
+  if (barriers.empty())
+    return;
+
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .imageMemoryBarrierCount = static_cast<std::uint32_t>(barriers.size()),
+    .pImageMemoryBarriers = barriers.data(),
+  });
+}
+
+void TransientImagePool::endPass(vk::CommandBuffer cmd_buf, std::uint32_t pass)
+{
+  bool anyEnded = false;
+  for (std::size_t i = 0; i < compiledDeclarations.size(); ++i)
+  {
+    const auto& decl = compiledDeclarations[i];
+    if (decl.lastPass != pass)
+      continue;
+
+    // NOTE: etna tracks layouts of every image it has seen, and has no idea that the
+    // barrier in beginPass happened. Parking the image in its first layout makes etna's
+    // state match what beginPass leaves the image in next time.
+    etna::set_state(
+      cmd_buf,
+      images[i].image.get(),
+      vk::PipelineStageFlagBits2::eAllCommands,
+      {},
+      decl.desc.firstLayout,
+      decl.desc.aspect);
+    anyEnded = true;
+  }
+
+  if (anyEnded)
+    etna::flush_barriers(cmd_buf);
+}
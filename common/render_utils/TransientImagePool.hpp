@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Render targets which only live for a part of a frame, e.g. depth buffers and G-buffers.
+ * Every frame, passes declare the images they need along with the range of passes that
+ * use them. Images whose ranges don't overlap are placed into the same memory, so the
+ * pool needs far less memory than allocating every target separately would.
+ *
+ * Contents never survive from one frame to the next, the first pass that uses an image
+ * has to clear it or overwrite it completely. Images and memory are kept for as long
+ * as the declarations stay the same, and are recreated when they change, e.g. on resize.
+ */
+class TransientImagePool
+{
+public:
+  struct ImageDesc
+  {
+    // Shows up in validation messages and captures
+    std::string name;
+    vk::Extent2D extent;
+    vk::Format format;
+    vk::ImageUsageFlags usage;
+    vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+    // The layout the first pass using the image wants it in
+    vk::ImageLayout firstLayout;
+
+    bool operator==(const ImageDesc&) const = default;
+  };
+
+  using ImageId = std::uint32_t;
+
+  TransientImagePool() = default;
+
+  TransientImagePool(const TransientImagePool&) = delete;
+  TransientImagePool& operator=(const TransientImagePool&) = delete;
+
+  // Forgets the declarations of the previous frame and frees retired memory
+  void beginFrame();
+
+  // The image is used by passes `first_pass` through `last_pass`, both inclusive.
+  // Passes are numbered in the order they are recorded in.
+  ImageId declare(ImageDesc desc, std::uint32_t first_pass, std::uint32_t last_pass);
+
+  // Places the declared images into memory, has to be called before recording any passes
+  void compile();
+
+  // Record these around each pass. Images starting their lifetime in the pass get
+  // a barrier against the previous users of their memory. Images ending it are left
+  // in their first layout, so etna's idea of their layout stays right.
+  void beginPass(vk::CommandBuffer cmd_buf, std::uint32_t pass);
+  void endPass(vk::CommandBuffer cmd_buf, std::uint32_t pass);
+
+  vk::Image getImage(ImageId id) const { return images[id].image.get(); }
+  vk::ImageView getView(ImageId id) const { return images[id].view.get(); }
+
+  struct Stats
+  {
+    // Size of the memory shared by all images
+    vk::DeviceSize aliasedBytes = 0;
+    // What the images would take up without aliasing
+    vk::DeviceSize separateBytes = 0;
+  };
+
+  Stats getStats() const { return stats; }
+
+private:
+  struct Declaration
+  {
+    ImageDesc desc;
+    std::uint32_t firstPass;
+    std::uint32_t lastPass;
+
+    bool operator==(const Declaration&) const = default;
+  };
+
+  struct PlacedImage
+  {
+    vk::UniqueImage image;
+    vk::UniqueImageView view;
+  };
+
+  void retireImages();
+
+private:
+  std::vector<Declaration> declarations;
+  std::vector<Declaration> compiledDeclarations;
+
+  // NOTE: views and images must be destroyed before the memory they are bound to
+  vk::UniqueDeviceMemory memory;
+  std::vector<PlacedImage> images;
+  Stats stats;
+
+  struct RetiredImages
+  {
+    std::uint64_t releaseFrame;
+    vk::UniqueDeviceMemory memory;
+    std::vector<PlacedImage> images;
+  };
+
+  std::deque<RetiredImages> retiredImages;
+  std::uint64_t frameIndex = 0;
+};
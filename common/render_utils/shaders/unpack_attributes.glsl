@@ -3,6 +3,7 @@
 
 // NOTE: .glsl extension is used for helper files with shader code
 
+// NOTE: mirrored on the CPU in scene/NormalEncoding.hpp, keep these in sync
 vec3 decode_normal(uint a_data)
 {
   const uint a_enc_x = (a_data  & 0x0000FFFFu);
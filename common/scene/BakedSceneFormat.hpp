@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+// Description of the files produced by model_bakery_baker. For `scene.gltf` it writes
+//  - `scene_baked.gltf`: a regular glTF file using KHR_mesh_quantization, for debugging
+//  - `scene_baked.bin`: the glTF buffer, BakedVertex-es followed by uint32 indices.
+//    Indices of every relem are followed by the indices of its simplified LODs,
+//    which reference the same vertices. The debug glTF only describes LOD 0.
+//  - `scene_baked.meta`: a compact index of the scene described below
+// The index contains everything SceneManager needs to know about the scene, so that
+// baked scenes are loaded by mapping the files into memory, without any parsing.
+//
+// Layout of the .meta file, all arrays are tightly packed and follow one another:
+//   BakedSceneHeader
+//   BakedRenderElement[relemCount]
+//   BakedRenderElementLod[lodCount]
+//   BakedRenderElementBounds[relemCount]
+//   BakedMesh[meshCount]
+//   glm::mat4x4[instanceCount] (instance matrices)
+//   std::uint32_t[instanceCount] (instance meshes)
+
+inline constexpr std::uint32_t BAKED_SCENE_MAGIC = 0x4e435342; // "BSCN"
+inline constexpr std::uint32_t BAKED_SCENE_VERSION = 4;
+
+struct BakedSceneHeader
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+
+  std::uint32_t vertexCount;
+  std::uint32_t indexCount;
+  std::uint32_t relemCount;
+  std::uint32_t meshCount;
+  std::uint32_t instanceCount;
+  std::uint32_t lodCount;
+
+  // Offsets of vertex and index data inside of the .bin file
+  std::uint64_t vertexByteOffset;
+  std::uint64_t indexByteOffset;
+};
+
+static_assert(sizeof(BakedSceneHeader) == 48);
+
+struct BakedRenderElement
+{
+  std::uint32_t vertexOffset;
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  std::uint32_t firstLod;
+  std::uint32_t lodCount;
+};
+
+// LOD 0 of every relem is the relem itself, errors of the following ones increase
+struct BakedRenderElementLod
+{
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  float error;
+};
+
+// Mesh-space bounds of the vertices of a relem
+struct BakedRenderElementBounds
+{
+  glm::vec3 aabbMin;
+  glm::vec3 aabbMax;
+  glm::vec3 sphereCenter;
+  float sphereRadius;
+};
+
+struct BakedMesh
+{
+  std::uint32_t firstRelem;
+  std::uint32_t relemCount;
+};
+
+// Normals and tangents are signed normalized bytes as required by KHR_mesh_quantization,
+// so they map to VK_FORMAT_R8G8B8A8_SNORM directly. The 4th tangent component
+// is the glTF handedness of the bitangent, 1 or -1. The 4th normal component is 0.
+struct BakedVertex
+{
+  glm::vec3 position;
+  std::int8_t normal[4];
+  glm::vec2 texcoord;
+  std::int8_t tangent[4];
+  std::uint32_t padding;
+};
+
+static_assert(sizeof(BakedVertex) == 32);
@@ -0,0 +1,62 @@
+#include "CpuFeatures.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+
+
+// NOTE: the OS has to save the upper halves of the YMM registers on context switches,
+// otherwise AVX instructions are not usable even if the CPU has them.
+static bool os_supports_avx()
+{
+  int info[4];
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+}
+
+bool cpu_supports_avx()
+{
+  static const bool result = os_supports_avx();
+  return result;
+}
+
+bool cpu_supports_avx2()
+{
+  static const bool result = []() {
+    if (!os_supports_avx())
+      return false;
+    int info[4];
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+  }();
+  return result;
+}
+
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+
+// These check that the OS saves the registers as well
+bool cpu_supports_avx()
+{
+  return __builtin_cpu_supports("avx");
+}
+
+bool cpu_supports_avx2()
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool cpu_supports_avx()
+{
+  return false;
+}
+
+bool cpu_supports_avx2()
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+
+// Whether the CPU the program runs on has these instruction sets and the OS saves
+// the wider registers they use. Always false on CPUs which are not x86.
+// Code using them lives in separate files compiled with the instruction set enabled,
+// see CMakeLists.txt, and must only be called when these return true.
+bool cpu_supports_avx();
+bool cpu_supports_avx2();
@@ -0,0 +1,116 @@
+#include "FrustumCulling.hpp"
+
+#include <bit>
+
+#include "CpuFeatures.hpp"
+#include "FrustumCullingAvx.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLING_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define FRUSTUM_CULLING_USE_SSE 0
+#endif
+
+
+FrustumPlanes extract_frustum_planes(const glm::mat4x4& proj_view)
+{
+  // Gribb & Hartmann, glm matrices are column-major
+  const auto row = [&proj_view](int i) {
+    return glm::vec4(proj_view[0][i], proj_view[1][i], proj_view[2][i], proj_view[3][i]);
+  };
+
+  FrustumPlanes planes{
+    row(3) + row(0),
+    row(3) - row(0),
+    row(3) + row(1),
+    row(3) - row(1),
+    row(2),
+    row(3) - row(2),
+  };
+
+  for (auto& plane : planes)
+    plane /= glm::length(glm::vec3(plane));
+
+  return planes;
+}
+
+namespace
+{
+
+// Operations are done in the same order as in the SIMD versions to get the same rounding
+bool sphere_visible(const FrustumPlanes& planes, glm::vec3 center, float radius)
+{
+  for (const auto& plane : planes)
+    if (plane.w + center.x * plane.x + center.y * plane.y + center.z * plane.z < -radius)
+      return false;
+  return true;
+}
+
+// Pushes indices `base + i` for every set bit i of `mask`
+void emit_visible(std::uint32_t mask, std::uint32_t base, std::vector<std::uint32_t>& visible)
+{
+  while (mask != 0)
+  {
+    visible.push_back(base + static_cast<std::uint32_t>(std::countr_zero(mask)));
+    mask &= mask - 1;
+  }
+}
+
+} // namespace
+
+void cull_spheres(
+  const BoundingSpheres& spheres,
+  const FrustumPlanes& planes,
+  std::vector<std::uint32_t>& visible)
+{
+  const std::size_t count = spheres.size();
+  visible.clear();
+  visible.reserve(count);
+
+  std::size_t i = 0;
+
+  if (cpu_supports_avx())
+  {
+    // NOTE: the AVX file can't use std::vector, so it writes to preallocated storage
+    std::size_t visibleCount = 0;
+    visible.resize(count);
+    i = cull_spheres_avx(
+      spheres.x.data(),
+      spheres.y.data(),
+      spheres.z.data(),
+      spheres.radius.data(),
+      count,
+      &planes[0].x,
+      visible.data(),
+      visibleCount);
+    visible.resize(visibleCount);
+  }
+
+#if FRUSTUM_CULLING_USE_SSE
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128 x = _mm_loadu_ps(spheres.x.data() + i);
+    const __m128 y = _mm_loadu_ps(spheres.y.data() + i);
+    const __m128 z = _mm_loadu_ps(spheres.z.data() + i);
+    const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius.data() + i));
+
+    __m128 outside = _mm_setzero_ps();
+    for (const auto& plane : planes)
+    {
+      __m128 dist = _mm_set1_ps(plane.w);
+      dist = _mm_add_ps(dist, _mm_mul_ps(x, _mm_set1_ps(plane.x)));
+      dist = _mm_add_ps(dist, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+      dist = _mm_add_ps(dist, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+    }
+
+    emit_visible(~_mm_movemask_ps(outside) & 0xfu, static_cast<std::uint32_t>(i), visible);
+  }
+#endif
+
+  for (; i < count; ++i)
+    if (sphere_visible(
+          planes, glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i]))
+      visible.push_back(static_cast<std::uint32_t>(i));
+}
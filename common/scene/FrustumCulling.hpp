@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Bounding spheres stored as a structure of arrays, so that culling can load
+// the same component of 8 spheres with a single instruction.
+struct BoundingSpheres
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+
+  std::size_t size() const { return x.size(); }
+
+  void push_back(glm::vec3 center, float r)
+  {
+    x.push_back(center.x);
+    y.push_back(center.y);
+    z.push_back(center.z);
+    radius.push_back(r);
+  }
+
+  glm::vec4 get(std::size_t i) const { return glm::vec4(x[i], y[i], z[i], radius[i]); }
+
+  void set(std::size_t i, glm::vec3 center, float r)
+  {
+    x[i] = center.x;
+    y[i] = center.y;
+    z[i] = center.z;
+    radius[i] = r;
+  }
+};
+
+// Planes with normals pointing inside of the frustum, dot(plane, vec4(p, 1)) >= 0 for
+// points inside. Normals are normalized, so plane equations give signed distances.
+using FrustumPlanes = std::array<glm::vec4, 6>;
+
+// Extracts the frustum planes of a Vulkan (0 <= z <= w) projection-view matrix
+FrustumPlanes extract_frustum_planes(const glm::mat4x4& proj_view);
+
+// Writes the indices of spheres which intersect the frustum to `visible` in increasing order.
+// Uses SIMD where available, the result is the same as that of a scalar test.
+void cull_spheres(
+  const BoundingSpheres& spheres,
+  const FrustumPlanes& planes,
+  std::vector<std::uint32_t>& visible);
@@ -0,0 +1,64 @@
+#include "FrustumCullingAvx.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+
+
+std::size_t cull_spheres_avx(
+  const float* x,
+  const float* y,
+  const float* z,
+  const float* radius,
+  std::size_t count,
+  const float* planes,
+  std::uint32_t* visible,
+  std::size_t& visible_count)
+{
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    const __m256 cx = _mm256_loadu_ps(x + i);
+    const __m256 cy = _mm256_loadu_ps(y + i);
+    const __m256 cz = _mm256_loadu_ps(z + i);
+    const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+
+    // A sphere is outside if it's entirely behind any of the planes
+    __m256 outside = _mm256_setzero_ps();
+    for (std::size_t p = 0; p < 6; ++p)
+    {
+      const float* plane = planes + 4 * p;
+      __m256 dist = _mm256_set1_ps(plane[3]);
+      dist = _mm256_add_ps(dist, _mm256_mul_ps(cx, _mm256_set1_ps(plane[0])));
+      dist = _mm256_add_ps(dist, _mm256_mul_ps(cy, _mm256_set1_ps(plane[1])));
+      dist = _mm256_add_ps(dist, _mm256_mul_ps(cz, _mm256_set1_ps(plane[2])));
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, negRadius, _CMP_LT_OQ));
+    }
+
+    // Branchless compaction, every index is written but only visible ones are kept
+    const auto mask = static_cast<std::uint32_t>(~_mm256_movemask_ps(outside) & 0xff);
+    for (std::uint32_t k = 0; k < 8; ++k)
+    {
+      visible[visible_count] = static_cast<std::uint32_t>(i) + k;
+      visible_count += (mask >> k) & 1u;
+    }
+  }
+  return i;
+}
+
+#else
+
+// Not an x86 build, cpu_supports_avx() is always false
+std::size_t cull_spheres_avx(
+  const float*,
+  const float*,
+  const float*,
+  const float*,
+  std::size_t,
+  const float*,
+  std::uint32_t*,
+  std::size_t&)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// AVX part of cull_spheres. Tests as many spheres as it can in batches of 8, writes the
+// indices of visible ones to `visible` and returns how many spheres were tested, the rest is
+// left to the caller. `planes` are the 6 frustum planes as xyzw. Only call if cpu_supports_avx().
+// NOTE: this header is included by a file compiled with AVX enabled, so it must not
+// include anything with inline functions, as those could end up using AVX everywhere.
+std::size_t cull_spheres_avx(
+  const float* x,
+  const float* y,
+  const float* z,
+  const float* radius,
+  std::size_t count,
+  const float* planes,
+  std::uint32_t* visible,
+  std::size_t& visible_count);
@@ -0,0 +1,88 @@
+#include "GltfInstances.hpp"
+
+#include <algorithm>
+#include <stack>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+
+GltfInstances process_instances(const tinygltf::Model& model)
+{
+  std::vector nodeTransforms(model.nodes.size(), glm::identity<glm::mat4x4>());
+
+  for (std::size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx)
+  {
+    const auto& node = model.nodes[nodeIdx];
+    auto& transform = nodeTransforms[nodeIdx];
+
+    if (!node.matrix.empty())
+    {
+      for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+          transform[i][j] = static_cast<float>(node.matrix[4 * i + j]);
+    }
+    else
+    {
+      if (!node.scale.empty())
+        transform = scale(
+          transform,
+          glm::vec3(
+            static_cast<float>(node.scale[0]),
+            static_cast<float>(node.scale[1]),
+            static_cast<float>(node.scale[2])));
+
+      if (!node.rotation.empty())
+        transform *= mat4_cast(glm::quat(
+          static_cast<float>(node.rotation[3]),
+          static_cast<float>(node.rotation[0]),
+          static_cast<float>(node.rotation[1]),
+          static_cast<float>(node.rotation[2])));
+
+      if (!node.translation.empty())
+        transform = translate(
+          transform,
+          glm::vec3(
+            static_cast<float>(node.translation[0]),
+            static_cast<float>(node.translation[1]),
+            static_cast<float>(node.translation[2])));
+    }
+  }
+
+  std::stack<std::size_t> vertices;
+  for (auto vert : model.scenes[std::max(model.defaultScene, 0)].nodes)
+    vertices.push(vert);
+
+  while (!vertices.empty())
+  {
+    auto vert = vertices.top();
+    vertices.pop();
+
+    for (auto child : model.nodes[vert].children)
+    {
+      nodeTransforms[child] = nodeTransforms[vert] * nodeTransforms[child];
+      vertices.push(child);
+    }
+  }
+
+  GltfInstances result;
+
+  // Don't overallocate matrices, they are pretty chonky.
+  {
+    std::size_t totalNodesWithMeshes = 0;
+    for (std::size_t i = 0; i < model.nodes.size(); ++i)
+      if (model.nodes[i].mesh >= 0)
+        ++totalNodesWithMeshes;
+    result.matrices.reserve(totalNodesWithMeshes);
+    result.meshes.reserve(totalNodesWithMeshes);
+  }
+
+  for (std::size_t i = 0; i < model.nodes.size(); ++i)
+    if (model.nodes[i].mesh >= 0)
+    {
+      result.matrices.push_back(nodeTransforms[i]);
+      result.meshes.push_back(model.nodes[i].mesh);
+    }
+
+  return result;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+
+struct GltfInstances
+{
+  std::vector<glm::mat4x4> matrices;
+  std::vector<std::uint32_t> meshes;
+};
+
+// Flattens the node hierarchy of the default scene into a world matrix and a mesh index
+// for every node that has a mesh. Shared by SceneManager and the offline baker.
+GltfInstances process_instances(const tinygltf::Model& model);
@@ -0,0 +1,181 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  HANDLE file = CreateFileW(
+    path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+    nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    spdlog::error("Unable to open {}!", path);
+    return;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    spdlog::error("Unable to map {}, it is empty or its size is unknown!", path);
+    CloseHandle(file);
+    return;
+  }
+
+  // NOTE: the mapping keeps the file alive, so the handle can be closed right away
+  mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr)
+  {
+    spdlog::error("Unable to map {}!", path);
+    return;
+  }
+
+  data = static_cast<std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (data == nullptr)
+  {
+    spdlog::error("Unable to map {}!", path);
+    CloseHandle(mapping);
+    mapping = nullptr;
+    return;
+  }
+
+  size = static_cast<std::size_t>(fileSize.QuadPart);
+}
+
+void MappedFile::reset()
+{
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (mapping != nullptr)
+    CloseHandle(mapping);
+  data = nullptr;
+  mapping = nullptr;
+  size = 0;
+}
+
+void MappedFile::prefetch() const
+{
+  if (data == nullptr)
+    return;
+  WIN32_MEMORY_RANGE_ENTRY range{
+    .VirtualAddress = data,
+    .NumberOfBytes = size,
+  };
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+  , mapping{std::exchange(other.mapping, nullptr)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    reset();
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+    mapping = std::exchange(other.mapping, nullptr);
+  }
+  return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    spdlog::error("Unable to open {}!", path);
+    return;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    spdlog::error("Unable to map {}, it is empty or its size is unknown!", path);
+    close(fd);
+    return;
+  }
+
+  const auto fileSize = static_cast<std::size_t>(fileStat.st_size);
+
+  // NOTE: the mapping keeps the file alive, so the descriptor can be closed right away
+  void* ptr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED)
+  {
+    spdlog::error("Unable to map {}!", path);
+    return;
+  }
+
+  // We only ever stream through the file from start to end
+  madvise(ptr, fileSize, MADV_SEQUENTIAL);
+
+  data = static_cast<std::byte*>(ptr);
+  size = fileSize;
+}
+
+void MappedFile::reset()
+{
+  if (data != nullptr)
+    munmap(data, size);
+  data = nullptr;
+  size = 0;
+}
+
+void MappedFile::prefetch() const
+{
+  if (data != nullptr)
+    madvise(data, size, MADV_WILLNEED);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    reset();
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+  }
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  reset();
+}
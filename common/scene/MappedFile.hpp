@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+
+// A read-only view of a whole file mapped into memory. Pages are loaded
+// by the OS lazily on first access, so nothing is read until it is needed.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  // Check validity with `operator bool`, errors are logged
+  explicit MappedFile(const std::filesystem::path& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  ~MappedFile();
+
+  std::span<const std::byte> getData() const { return {data, size}; }
+
+  // Asks the OS to start reading the whole file in the background, does not block
+  void prefetch() const;
+
+  explicit operator bool() const { return data != nullptr; }
+
+private:
+  void reset();
+
+private:
+  // The pages are read-only, but unmapping and prefetching want a mutable pointer
+  std::byte* data = nullptr;
+  std::size_t size = 0;
+#ifdef _WIN32
+  void* mapping = nullptr;
+#endif
+};
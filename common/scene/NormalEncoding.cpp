@@ -0,0 +1,131 @@
+#include "NormalEncoding.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "CpuFeatures.hpp"
+#include "NormalEncodingAvx2.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMAL_ENCODING_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define NORMAL_ENCODING_USE_SSE 0
+#endif
+
+
+std::uint32_t encode_normal(glm::vec3 normal)
+{
+  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
+  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+
+  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
+  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
+  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+
+  return sx | sy;
+}
+
+glm::vec3 decode_normal(std::uint32_t packed)
+{
+  const std::uint32_t encX = packed & 0x0000FFFFu;
+  const std::uint32_t encY = (packed & 0xFFFF0000u) >> 16;
+  const float sign = (encX & 0x0001u) != 0 ? -1.0f : 1.0f;
+
+  const std::int32_t usX = static_cast<std::int32_t>(encX & 0x0000FFFEu);
+  const std::int32_t usY = static_cast<std::int32_t>(encY & 0x0000FFFFu);
+
+  const std::int32_t sX = usX <= 32767 ? usX : usX - 65536;
+  const std::int32_t sY = usY <= 32767 ? usY : usY - 65536;
+
+  const float x = static_cast<float>(sX) * (1.0f / 32767.0f);
+  const float y = static_cast<float>(sY) * (1.0f / 32767.0f);
+  const float z = sign * std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+
+  return glm::vec3(x, y, z);
+}
+
+namespace
+{
+
+#if NORMAL_ENCODING_USE_SSE
+
+// Same as encode_normal, 4 normals at a time. cvttps truncates just like
+// static_cast does, and "not greater or equal" matches `z >= 0 ? 0 : 1` for NaNs too.
+__m128i encode_normals_x4(__m128 x, __m128 y, __m128 z)
+{
+  const __m128 scale = _mm_set1_ps(32767.0f);
+  const __m128i ix = _mm_cvttps_epi32(_mm_mul_ps(x, scale));
+  const __m128i iy = _mm_cvttps_epi32(_mm_mul_ps(y, scale));
+
+  const __m128i sign = _mm_srli_epi32(_mm_castps_si128(_mm_cmpnge_ps(z, _mm_setzero_ps())), 31);
+  const __m128i sx = _mm_or_si128(_mm_and_si128(ix, _mm_set1_epi32(0xfffe)), sign);
+  // Shifting left by 16 drops the high bits, so no masking is required
+  const __m128i sy = _mm_slli_epi32(iy, 16);
+
+  return _mm_or_si128(sx, sy);
+}
+
+#endif
+
+} // namespace
+
+void encode_normals(const std::byte* normals, std::size_t stride, std::span<std::uint32_t> packed)
+{
+  const std::size_t count = packed.size();
+  std::size_t i = 0;
+
+  // NOTE: AVX2 isn't a part of the baseline we compile for, so it's checked at runtime
+  if (cpu_supports_avx2())
+    i = encode_normals_avx2(normals, stride, packed.data(), count);
+
+#if NORMAL_ENCODING_USE_SSE
+  if (stride == sizeof(glm::vec3))
+  {
+    // Tightly packed: [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3]
+    for (; i + 4 <= count; i += 4)
+    {
+      const auto* src = reinterpret_cast<const float*>(normals + i * stride);
+      const __m128 n0 = _mm_loadu_ps(src + 0);
+      const __m128 n1 = _mm_loadu_ps(src + 4);
+      const __m128 n2 = _mm_loadu_ps(src + 8);
+
+      // [x2 y2 z2 x3]
+      const __m128 n12 = _mm_shuffle_ps(n1, n2, _MM_SHUFFLE(1, 0, 3, 2));
+      // [y0 z0 y1 z1] and [y2 z2 y3 z3]
+      const __m128 yz01 = _mm_shuffle_ps(n0, n1, _MM_SHUFFLE(1, 0, 2, 1));
+      const __m128 yz23 = _mm_shuffle_ps(n12, n2, _MM_SHUFFLE(3, 2, 2, 1));
+
+      const __m128 x = _mm_shuffle_ps(n0, n12, _MM_SHUFFLE(3, 0, 3, 0));
+      const __m128 y = _mm_shuffle_ps(yz01, yz23, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m128 z = _mm_shuffle_ps(yz01, yz23, _MM_SHUFFLE(3, 1, 3, 1));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(packed.data() + i), encode_normals_x4(x, y, z));
+    }
+  }
+  else if (stride >= 4 * sizeof(float))
+  {
+    // Every load grabs 4 floats, so we must stop while there is at least
+    // one more element after the current block to not read past the end.
+    for (; i + 4 < count; i += 4)
+    {
+      const std::byte* src = normals + i * stride;
+      __m128 x = _mm_loadu_ps(reinterpret_cast<const float*>(src + 0 * stride));
+      __m128 y = _mm_loadu_ps(reinterpret_cast<const float*>(src + 1 * stride));
+      __m128 z = _mm_loadu_ps(reinterpret_cast<const float*>(src + 2 * stride));
+      __m128 w = _mm_loadu_ps(reinterpret_cast<const float*>(src + 3 * stride));
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(packed.data() + i), encode_normals_x4(x, y, z));
+    }
+  }
+#endif
+
+  for (; i < count; ++i)
+  {
+    glm::vec3 normal;
+    std::memcpy(&normal, normals + i * stride, sizeof(normal));
+    packed[i] = encode_normal(normal);
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+
+
+// Packs a unit vector into 32 bits: 16 bits of x, 15 bits of y and the sign of z,
+// see decode_normal in unpack_attributes.glsl for the inverse.
+std::uint32_t encode_normal(glm::vec3 normal);
+
+// CPU mirror of decode_normal from unpack_attributes.glsl, bit for bit.
+glm::vec3 decode_normal(std::uint32_t packed);
+
+// Batch version of encode_normal, packs `packed.size()` normals which are
+// `stride` bytes apart, starting at `normals`. Uses SIMD where available,
+// the result is bit-identical to calling encode_normal on every normal.
+void encode_normals(const std::byte* normals, std::size_t stride, std::span<std::uint32_t> packed);
+
+inline void encode_normals(std::span<const glm::vec3> normals, std::span<std::uint32_t> packed)
+{
+  encode_normals(
+    reinterpret_cast<const std::byte*>(normals.data()),
+    sizeof(glm::vec3),
+    packed.first(normals.size()));
+}
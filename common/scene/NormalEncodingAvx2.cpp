@@ -0,0 +1,53 @@
+#include "NormalEncodingAvx2.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+
+// Same as encode_normal, 8 normals at a time, see encode_normals_x4 for details
+static __m256i encode_normals_x8(__m256 x, __m256 y, __m256 z)
+{
+  const __m256 scale = _mm256_set1_ps(32767.0f);
+  const __m256i ix = _mm256_cvttps_epi32(_mm256_mul_ps(x, scale));
+  const __m256i iy = _mm256_cvttps_epi32(_mm256_mul_ps(y, scale));
+
+  const __m256i sign = _mm256_srli_epi32(
+    _mm256_castps_si256(_mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_NGE_UQ)), 31);
+  const __m256i sx = _mm256_or_si256(_mm256_and_si256(ix, _mm256_set1_epi32(0xfffe)), sign);
+  const __m256i sy = _mm256_slli_epi32(iy, 16);
+
+  return _mm256_or_si256(sx, sy);
+}
+
+std::size_t encode_normals_avx2(
+  const std::byte* normals, std::size_t stride, std::uint32_t* packed, std::size_t count)
+{
+  // Gather offsets are 32 bit
+  if (stride * 8 > static_cast<std::size_t>(INT32_MAX))
+    return 0;
+
+  // Gathers work for any stride and never read past the vec3s themselves
+  const auto s = static_cast<int>(stride);
+  const __m256i offsets = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    const auto* base = reinterpret_cast<const float*>(normals + i * stride);
+    const __m256 x = _mm256_i32gather_ps(base + 0, offsets, 1);
+    const __m256 y = _mm256_i32gather_ps(base + 1, offsets, 1);
+    const __m256 z = _mm256_i32gather_ps(base + 2, offsets, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(packed + i), encode_normals_x8(x, y, z));
+  }
+  return i;
+}
+
+#else
+
+// Not an x86 build, cpu_supports_avx2() is always false
+std::size_t encode_normals_avx2(const std::byte*, std::size_t, std::uint32_t*, std::size_t)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// AVX2 part of encode_normals. Encodes as many normals as it can in batches of 8 and
+// returns how many, the rest is left to the caller. Only call if cpu_supports_avx2().
+// NOTE: this header is included by a file compiled with AVX2 enabled, so it must not
+// include anything with inline functions, as those could end up using AVX2 everywhere.
+std::size_t encode_normals_avx2(
+  const std::byte* normals, std::size_t stride, std::uint32_t* packed, std::size_t count);
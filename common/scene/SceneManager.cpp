@@ -1,21 +1,52 @@
 #include "SceneManager.hpp"
 
-#include <stack>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/gtc/quaternion.hpp>
 #include <etna/GlobalContext.hpp>
-#include <etna/OneShotCmdMgr.hpp>
+#include <etna/Profiling.hpp>
 
+#include "BakedSceneFormat.hpp"
+#include "GltfInstances.hpp"
+#include "MappedFile.hpp"
+#include "VertexDecoders.hpp"
+
+
+// The staging ring is split into equal chunks, up to one copy per chunk is in flight
+static constexpr vk::DeviceSize UPLOAD_RING_SIZE = 64 * 1024 * 1024;
+static constexpr std::uint32_t UPLOAD_CHUNK_COUNT = 4;
 
 SceneManager::SceneManager()
-  : oneShotCommands{etna::get_context().createOneShotCmdMgr()}
-  , transferHelper{etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 4}}
+  : SceneManager(CreateInfo{})
+{
+}
+
+SceneManager::SceneManager(const CreateInfo& info)
+  : positionStream{info.positionStream}
+  , uploader{StreamingUploader::CreateInfo{
+      .ringSize = UPLOAD_RING_SIZE,
+      .chunkCount = UPLOAD_CHUNK_COUNT,
+    }}
 {
 }
 
+SceneManager::~SceneManager()
+{
+  // The loading thread uses our members, and the GPU might still be copying
+  // into the buffers of the pending scene
+  if (loadingScene.valid())
+    loadingScene.wait();
+  uploader.waitIdle();
+}
+
 std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path path)
 {
   tinygltf::Model model;
@@ -53,100 +84,37 @@ std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path pat
   return model;
 }
 
-SceneManager::ProcessedInstances SceneManager::processInstances(const tinygltf::Model& model) const
+// Runs `job(i)` for every i in [0, count) on a pool of worker threads.
+// Jobs are handed out one by one, so a few huge jobs don't stall the rest.
+template <class F>
+static void parallel_for(std::size_t count, const F& job)
 {
-  std::vector nodeTransforms(model.nodes.size(), glm::identity<glm::mat4x4>());
-
-  for (std::size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx)
-  {
-    const auto& node = model.nodes[nodeIdx];
-    auto& transform = nodeTransforms[nodeIdx];
-
-    if (!node.matrix.empty())
-    {
-      for (int i = 0; i < 4; ++i)
-        for (int j = 0; j < 4; ++j)
-          transform[i][j] = static_cast<float>(node.matrix[4 * i + j]);
-    }
-    else
-    {
-      if (!node.scale.empty())
-        transform = scale(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.scale[0]),
-            static_cast<float>(node.scale[1]),
-            static_cast<float>(node.scale[2])));
-
-      if (!node.rotation.empty())
-        transform *= mat4_cast(glm::quat(
-          static_cast<float>(node.rotation[3]),
-          static_cast<float>(node.rotation[0]),
-          static_cast<float>(node.rotation[1]),
-          static_cast<float>(node.rotation[2])));
-
-      if (!node.translation.empty())
-        transform = translate(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.translation[0]),
-            static_cast<float>(node.translation[1]),
-            static_cast<float>(node.translation[2])));
-    }
-  }
-
-  std::stack<std::size_t> vertices;
-  for (auto vert : model.scenes[model.defaultScene].nodes)
-    vertices.push(vert);
-
-  while (!vertices.empty())
-  {
-    auto vert = vertices.top();
-    vertices.pop();
+  if (count == 0)
+    return;
 
-    for (auto child : model.nodes[vert].children)
-    {
-      nodeTransforms[child] = nodeTransforms[vert] * nodeTransforms[child];
-      vertices.push(child);
-    }
-  }
+  const std::size_t workerCount =
+    std::min<std::size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
 
-  ProcessedInstances result;
+  std::atomic<std::size_t> next{0};
+  auto worker = [&]() {
+    for (std::size_t i = next++; i < count; i = next++)
+      job(i);
+  };
 
-  // Don't overallocate matrices, they are pretty chonky.
   {
-    std::size_t totalNodesWithMeshes = 0;
-    for (std::size_t i = 0; i < model.nodes.size(); ++i)
-      if (model.nodes[i].mesh >= 0)
-        ++totalNodesWithMeshes;
-    result.matrices.reserve(totalNodesWithMeshes);
-    result.meshes.reserve(totalNodesWithMeshes);
+    std::vector<std::jthread> workers;
+    workers.reserve(workerCount - 1);
+    for (std::size_t i = 1; i < workerCount; ++i)
+      workers.emplace_back(worker);
+    // The calling thread is a worker too
+    worker();
   }
-
-  for (std::size_t i = 0; i < model.nodes.size(); ++i)
-    if (model.nodes[i].mesh >= 0)
-    {
-      result.matrices.push_back(nodeTransforms[i]);
-      result.meshes.push_back(model.nodes[i].mesh);
-    }
-
-  return result;
-}
-
-static std::uint32_t encode_normal(glm::vec3 normal)
-{
-  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
-  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
-
-  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
-  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
-  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
-
-  return sx | sy;
 }
 
 SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model& model) const
 {
+  ZoneScoped;
+
   // NOTE: glTF assets can have pretty wonky data layouts which are not appropriate
   // for real-time rendering, so we have to press the data first. In serious engines
   // this is mitigated by storing assets on the disc in an engine-specific format that
@@ -154,38 +122,42 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 
   ProcessedMeshes result;
 
-  // Pre-allocate enough memory so as not to hit the
-  // allocator on the memcpy hotpath
+  // Everything we need to know about a primitive in order to decode it
+  // without touching the result arrays of other primitives.
+  struct PrimitiveSource
   {
-    std::size_t vertexBytes = 0;
-    std::size_t indexBytes = 0;
-    for (const auto& bufView : model.bufferViews)
-    {
-      switch (bufView.target)
-      {
-      case TINYGLTF_TARGET_ARRAY_BUFFER:
-        vertexBytes += bufView.byteLength;
-        break;
-      case TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER:
-        indexBytes += bufView.byteLength;
-        break;
-      default:
-        break;
-      }
-    }
-    result.vertices.reserve(vertexBytes / sizeof(Vertex));
-    result.indices.reserve(indexBytes / sizeof(std::uint32_t));
-  }
+    AttributeStream position;
+    AttributeStream normal;
+    AttributeStream tangent;
+    AttributeStream texcoord;
+    VertexDecoder positionNormalDecoder;
+    VertexDecoder texcoordTangentDecoder;
+    const std::byte* indices;
+    int indexComponentType;
+    std::uint32_t vertexCount;
+    std::uint32_t indexCount;
+    std::uint32_t vertexOffset;
+    std::uint32_t indexOffset;
+  };
+
+  std::vector<PrimitiveSource> primitives;
 
   {
     std::size_t totalPrimitives = 0;
     for (const auto& mesh : model.meshes)
       totalPrimitives += mesh.primitives.size();
     result.relems.reserve(totalPrimitives);
+    result.lods.reserve(totalPrimitives);
+    primitives.reserve(totalPrimitives);
   }
 
   result.meshes.reserve(model.meshes.size());
 
+  // First pass: gather source pointers of all primitives and compute their
+  // output vertex/index offsets with a prefix sum. This is cheap, as no
+  // vertex data is touched here.
+  std::uint32_t totalVertices = 0;
+  std::uint32_t totalIndices = 0;
   for (const auto& mesh : model.meshes)
   {
     result.meshes.push_back(Mesh{
@@ -203,197 +175,793 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         continue;
       }
 
-      const auto normalIt = prim.attributes.find("NORMAL");
-      const auto tangentIt = prim.attributes.find("TANGENT");
-      const auto texcoordIt = prim.attributes.find("TEXCOORD_0");
-
-      const bool hasNormals = normalIt != prim.attributes.end();
-      const bool hasTangents = tangentIt != prim.attributes.end();
-      const bool hasTexcoord = texcoordIt != prim.attributes.end();
-      std::array accessorIndices{
-        prim.indices,
-        prim.attributes.at("POSITION"),
-        hasNormals ? normalIt->second : -1,
-        hasTangents ? tangentIt->second : -1,
-        hasTexcoord ? texcoordIt->second : -1,
+      const auto attributeStream = [&model](const tinygltf::Accessor& accessor) {
+        const auto& bufView = model.bufferViews[accessor.bufferView];
+        return AttributeStream{
+          .data = reinterpret_cast<const std::byte*>(model.buffers[bufView.buffer].data.data()) +
+            bufView.byteOffset + accessor.byteOffset,
+          .stride = bufView.byteStride != 0
+            ? bufView.byteStride
+            : tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+              tinygltf::GetNumComponentsInType(accessor.type),
+          .format = attribute_format(accessor.componentType, accessor.normalized),
+        };
       };
 
-      std::array accessors{
-        &model.accessors[prim.indices],
-        &model.accessors[accessorIndices[1]],
-        hasNormals ? &model.accessors[accessorIndices[2]] : nullptr,
-        hasTangents ? &model.accessors[accessorIndices[3]] : nullptr,
-        hasTexcoord ? &model.accessors[accessorIndices[4]] : nullptr,
+      const auto optionalStream = [&](const char* name) {
+        const auto it = prim.attributes.find(name);
+        return it != prim.attributes.end() ? attributeStream(model.accessors[it->second])
+                                           : AttributeStream{};
       };
 
-      std::array bufViews{
-        &model.bufferViews[accessors[0]->bufferView],
-        &model.bufferViews[accessors[1]->bufferView],
-        hasNormals ? &model.bufferViews[accessors[2]->bufferView] : nullptr,
-        hasTangents ? &model.bufferViews[accessors[3]->bufferView] : nullptr,
-        hasTexcoord ? &model.bufferViews[accessors[4]->bufferView] : nullptr,
+      const auto& positionAccessor = model.accessors[prim.attributes.at("POSITION")];
+      const auto& indexAccessor = model.accessors[prim.indices];
+
+      PrimitiveSource src{
+        .position = attributeStream(positionAccessor),
+        .normal = optionalStream("NORMAL"),
+        .tangent = optionalStream("TANGENT"),
+        .texcoord = optionalStream("TEXCOORD_0"),
+        .positionNormalDecoder = nullptr,
+        .texcoordTangentDecoder = nullptr,
+        .indices = attributeStream(indexAccessor).data,
+        .indexComponentType = indexAccessor.componentType,
+        .vertexCount = static_cast<std::uint32_t>(positionAccessor.count),
+        .indexCount = static_cast<std::uint32_t>(indexAccessor.count),
+        .vertexOffset = totalVertices,
+        .indexOffset = totalIndices,
       };
 
+      // The decoders are specialized for every combination of attribute formats,
+      // so we pick them once per primitive instead of branching per vertex.
+      src.positionNormalDecoder = get_position_normal_decoder(src.position, src.normal);
+      src.texcoordTangentDecoder = get_texcoord_tangent_decoder(src.texcoord, src.tangent);
+      if (src.positionNormalDecoder == nullptr || src.texcoordTangentDecoder == nullptr)
+      {
+        spdlog::warn(
+          "Encountered a primitive with vertex formats not allowed by glTF, skipping it!");
+        --result.meshes.back().relemCount;
+        continue;
+      }
+
+      // Indices are guaranteed to have no stride
+      ETNA_VERIFY(model.bufferViews[indexAccessor.bufferView].byteStride == 0);
+
+      primitives.push_back(src);
+
+      totalVertices += src.vertexCount;
+      totalIndices += src.indexCount;
+
       result.relems.push_back(RenderElement{
-        .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
-        .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
-        .indexCount = static_cast<std::uint32_t>(accessors[0]->count),
+        .vertexOffset = src.vertexOffset,
+        .indexOffset = src.indexOffset,
+        .indexCount = src.indexCount,
+        .firstLod = static_cast<std::uint32_t>(result.lods.size()),
+        .lodCount = 1,
+      });
+      result.lods.push_back(RenderElementLod{
+        .indexOffset = src.indexOffset,
+        .indexCount = src.indexCount,
+        .error = 0,
       });
+    }
+  }
 
-      const std::size_t vertexCount = accessors[1]->count;
-
-      std::array ptrs{
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[0]->buffer].data.data()) +
-          bufViews[0]->byteOffset + accessors[0]->byteOffset,
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[1]->buffer].data.data()) +
-          bufViews[1]->byteOffset + accessors[1]->byteOffset,
-        hasNormals
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[2]->buffer].data.data()) +
-            bufViews[2]->byteOffset + accessors[2]->byteOffset
-          : nullptr,
-        hasTangents
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[3]->buffer].data.data()) +
-            bufViews[3]->byteOffset + accessors[3]->byteOffset
-          : nullptr,
-        hasTexcoord
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[4]->buffer].data.data()) +
-            bufViews[4]->byteOffset + accessors[4]->byteOffset
-          : nullptr,
-      };
+  // NOTE: resizing zero-initializes the arrays, which is a (cheap) extra pass
+  // over memory, but it's the price we pay for std::vector.
+  result.vertices.resize(totalVertices);
+  result.indices.resize(totalIndices);
 
-      std::array strides{
-        bufViews[0]->byteStride != 0
-          ? bufViews[0]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[0]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[0]->type),
-        bufViews[1]->byteStride != 0
-          ? bufViews[1]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[1]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[1]->type),
-        hasNormals ? (bufViews[2]->byteStride != 0
-                        ? bufViews[2]->byteStride
-                        : tinygltf::GetComponentSizeInBytes(accessors[2]->componentType) *
-                          tinygltf::GetNumComponentsInType(accessors[2]->type))
-                   : 0,
-        hasTangents ? (bufViews[3]->byteStride != 0
-                         ? bufViews[3]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[3]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[3]->type))
-                    : 0,
-        hasTexcoord ? (bufViews[4]->byteStride != 0
-                         ? bufViews[4]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[4]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[4]->type))
-                    : 0,
-      };
+  // Big primitives are split into chunks so that a single huge primitive
+  // does not end up being decoded by a single thread.
+  constexpr std::uint32_t CHUNK_VERTICES = 1 << 14;
+  constexpr std::uint32_t CHUNK_INDICES = 3 * CHUNK_VERTICES;
 
-      for (std::size_t i = 0; i < vertexCount; ++i)
-      {
-        auto& vtx = result.vertices.emplace_back();
-        glm::vec3 pos;
-        // Fall back to 0 in case we don't have something.
-        // NOTE: if tangents are not available, one could use http://mikktspace.com/
-        // NOTE: if normals are not available, reconstructing them is possible but will look ugly
-        glm::vec3 normal{0};
-        glm::vec3 tangent{0};
-        glm::vec2 texcoord{0};
-        std::memcpy(&pos, ptrs[1], sizeof(pos));
-
-        // NOTE: it's faster to do a template here with specializations for all combinations than to
-        // do ifs at runtime. Also, SIMD should be used. Try implementing this!
-        if (hasNormals)
-          std::memcpy(&normal, ptrs[2], sizeof(normal));
-        if (hasTangents)
-          std::memcpy(&tangent, ptrs[3], sizeof(tangent));
-        if (hasTexcoord)
-          std::memcpy(&texcoord, ptrs[4], sizeof(texcoord));
-
-
-        vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
-        vtx.texCoordAndTangentAndPadding =
-          glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
-
-        ptrs[1] += strides[1];
-        if (hasNormals)
-          ptrs[2] += strides[2];
-        if (hasTangents)
-          ptrs[3] += strides[3];
-        if (hasTexcoord)
-          ptrs[4] += strides[4];
-      }
+  struct DecodeJob
+  {
+    std::uint32_t primitive;
+    std::uint32_t chunk;
+  };
 
-      // Indices are guaranteed to have no stride
-      ETNA_VERIFY(bufViews[0]->byteStride == 0);
-      const std::size_t indexCount = accessors[0]->count;
-      if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
-      {
-        for (std::size_t i = 0; i < indexCount; ++i)
-        {
-          std::uint16_t index;
-          std::memcpy(&index, ptrs[0], sizeof(index));
-          result.indices.push_back(index);
-          ptrs[0] += 2;
-        }
-      }
-      else if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
+  std::vector<DecodeJob> jobs;
+  for (std::uint32_t primIdx = 0; primIdx < primitives.size(); ++primIdx)
+  {
+    const auto& src = primitives[primIdx];
+    const std::uint32_t chunkCount = std::max(
+      {1u,
+       (src.vertexCount + CHUNK_VERTICES - 1) / CHUNK_VERTICES,
+       (src.indexCount + CHUNK_INDICES - 1) / CHUNK_INDICES});
+    for (std::uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+      jobs.push_back(DecodeJob{.primitive = primIdx, .chunk = chunk});
+  }
+
+  // Second pass: decode all chunks in parallel straight into their final place.
+  parallel_for(jobs.size(), [&](std::size_t jobIdx) {
+    const auto& src = primitives[jobs[jobIdx].primitive];
+    const std::uint32_t chunk = jobs[jobIdx].chunk;
+
+    const std::uint32_t firstVertex = std::min(chunk * CHUNK_VERTICES, src.vertexCount);
+    const std::uint32_t lastVertex = std::min(firstVertex + CHUNK_VERTICES, src.vertexCount);
+
+    const auto advance = [firstVertex](AttributeStream stream) {
+      if (stream.data != nullptr)
+        stream.data += firstVertex * stream.stride;
+      return stream;
+    };
+
+    // NOTE: if tangents are not available, one could use http://mikktspace.com/
+    // NOTE: if normals are not available, reconstructing them is possible but will look ugly
+    // Absent attributes are decoded as zeroes.
+    Vertex* vtx = result.vertices.data() + src.vertexOffset + firstVertex;
+    src.positionNormalDecoder(
+      advance(src.position),
+      advance(src.normal),
+      lastVertex - firstVertex,
+      &vtx->positionAndNormal);
+    src.texcoordTangentDecoder(
+      advance(src.texcoord),
+      advance(src.tangent),
+      lastVertex - firstVertex,
+      &vtx->texCoordAndTangentAndPadding);
+
+    const std::uint32_t firstIndex = std::min(chunk * CHUNK_INDICES, src.indexCount);
+    const std::uint32_t lastIndex = std::min(firstIndex + CHUNK_INDICES, src.indexCount);
+    std::uint32_t* dst = result.indices.data() + src.indexOffset + firstIndex;
+    switch (src.indexComponentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      for (std::uint32_t i = firstIndex; i < lastIndex; ++i)
+        *dst++ = std::to_integer<std::uint32_t>(src.indices[i]);
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      for (std::uint32_t i = firstIndex; i < lastIndex; ++i)
       {
-        const std::size_t lastTotalIndices = result.indices.size();
-        result.indices.resize(lastTotalIndices + indexCount);
-        std::memcpy(
-          result.indices.data() + lastTotalIndices,
-          ptrs[0],
-          sizeof(result.indices[0]) * indexCount);
+        std::uint16_t index;
+        std::memcpy(&index, src.indices + i * sizeof(index), sizeof(index));
+        *dst++ = index;
       }
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      std::memcpy(
+        dst,
+        src.indices + firstIndex * sizeof(std::uint32_t),
+        sizeof(std::uint32_t) * (lastIndex - firstIndex));
+      break;
+    default:
+      break;
     }
-  }
+  });
+
+  // Third pass: bounds, the vertices are most likely still in the cache at this point
+  result.bounds.resize(primitives.size());
+  parallel_for(primitives.size(), [&](std::size_t primIdx) {
+    const auto& src = primitives[primIdx];
+    const auto vertices = std::span{result.vertices}.subspan(src.vertexOffset, src.vertexCount);
+
+    auto& bounds = result.bounds[primIdx];
+    bounds.aabbMin = glm::vec3{std::numeric_limits<float>::max()};
+    bounds.aabbMax = glm::vec3{std::numeric_limits<float>::lowest()};
+    for (const auto& vertex : vertices)
+    {
+      bounds.aabbMin = glm::min(bounds.aabbMin, glm::vec3(vertex.positionAndNormal));
+      bounds.aabbMax = glm::max(bounds.aabbMax, glm::vec3(vertex.positionAndNormal));
+    }
+
+    bounds.sphereCenter = (bounds.aabbMin + bounds.aabbMax) * 0.5f;
+    bounds.sphereRadius = 0;
+    for (const auto& vertex : vertices)
+      bounds.sphereRadius = std::max(
+        bounds.sphereRadius,
+        glm::distance(bounds.sphereCenter, glm::vec3(vertex.positionAndNormal)));
+  });
 
   return result;
 }
 
-void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+SceneManager::SceneBufferSources SceneManager::getBufferSources(
+  SceneBuffers& buffers, const SceneData& data)
 {
-  unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = vertices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
-    .name = "unifiedVbuf",
-  });
+  return {{
+    {&buffers.vertices, data.vertices},
+    {&buffers.indices, std::as_bytes(data.indices)},
+    {&buffers.positions, std::as_bytes(std::span{data.positions})},
+    {&buffers.instanceMatrices, std::as_bytes(std::span{data.instanceMatrices})},
+    {&buffers.instanceNormalMatrices, std::as_bytes(std::span{data.instanceNormalMatrices})},
+    {&buffers.instanceMeshes, std::as_bytes(std::span{data.instanceMeshes})},
+    {&buffers.meshes, std::as_bytes(std::span{data.meshes})},
+    {&buffers.meshSpheres, std::as_bytes(std::span{data.meshSpheres})},
+    {&buffers.relems, std::as_bytes(std::span{data.relems})},
+    {&buffers.lods, std::as_bytes(std::span{data.lods})},
+  }};
+}
 
-  unifiedIbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = indices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
-    .name = "unifiedIbuf",
-  });
+SceneManager::SceneBuffers SceneManager::createBuffers(const SceneData& data)
+{
+  const vk::BufferUsageFlags storage = vk::BufferUsageFlagBits::eStorageBuffer;
+  const std::array<std::pair<vk::BufferUsageFlags, const char*>, SCENE_BUFFER_COUNT> infos{{
+    {vk::BufferUsageFlagBits::eVertexBuffer, "unifiedVbuf"},
+    {vk::BufferUsageFlagBits::eIndexBuffer, "unifiedIbuf"},
+    {vk::BufferUsageFlagBits::eVertexBuffer, "positionVbuf"},
+    {storage, "instanceMatrices"},
+    {storage, "instanceNormalMatrices"},
+    {storage, "instanceMeshes"},
+    {storage, "meshes"},
+    {storage, "meshSpheres"},
+    {storage, "relems"},
+    {storage, "relemLods"},
+  }};
+
+  SceneBuffers result;
+  const auto sources = getBufferSources(result, data);
+  for (std::size_t i = 0; i < SCENE_BUFFER_COUNT; ++i)
+    *sources[i].first = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      // NOTE: empty buffers are not allowed by Vulkan
+      .size = std::max<std::size_t>(sources[i].second.size(), sizeof(glm::vec4)),
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | infos[i].first,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = infos[i].second,
+    });
 
-  transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
-  transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+  return result;
 }
 
-void SceneManager::selectScene(std::filesystem::path path)
+std::optional<SceneManager::SceneData> SceneManager::loadSceneData(std::filesystem::path path)
 {
+  ZoneScoped;
+
+  using Clock = std::chrono::steady_clock;
+  using Ms = std::chrono::duration<double, std::milli>;
+
+  const auto loadStart = Clock::now();
+
   auto maybeModel = loadModel(path);
   if (!maybeModel.has_value())
-    return;
+    return std::nullopt;
 
   auto model = std::move(*maybeModel);
 
+  SceneData result;
+
+  // NOTE: you might want to store these on the GPU for GPU-driven rendering.
+  auto [instMats, instMeshes] = process_instances(model);
+  result.instanceMatrices = std::move(instMats);
+  result.instanceMeshes = std::move(instMeshes);
+
+  const auto processStart = Clock::now();
+
+  auto [verts, inds, relems, lods, bounds, meshs] = processMeshes(model);
+  result.relems = std::move(relems);
+  result.lods = std::move(lods);
+  result.bounds = std::move(bounds);
+  result.meshes = std::move(meshs);
+  result.vertexStorage = std::move(verts);
+  result.indexStorage = std::move(inds);
+  result.vertices = std::as_bytes(std::span{result.vertexStorage});
+  result.indices = result.indexStorage;
+
+  if (positionStream)
+  {
+    result.positions.reserve(result.vertexStorage.size());
+    for (const auto& vertex : result.vertexStorage)
+      result.positions.emplace_back(vertex.positionAndNormal);
+  }
+
+  groupInstancesByMesh(result);
+  computeInstanceSpheres(result);
+  computeNormalMatrices(result);
+
+  const auto processEnd = Clock::now();
+
+  spdlog::info(
+    "Scene {}: {} vertices, {} indices. Parsed in {:.1f} ms, processed meshes in {:.1f} ms",
+    path,
+    result.vertexStorage.size(),
+    result.indexStorage.size(),
+    Ms(processStart - loadStart).count(),
+    Ms(processEnd - processStart).count());
+
+  return result;
+}
+
+std::optional<SceneManager::SceneData> SceneManager::loadBakedSceneData(
+  std::filesystem::path path)
+{
+  ZoneScoped;
+
+  MappedFile meta{std::filesystem::path{path}.replace_extension(".meta")};
+  MappedFile bin{std::filesystem::path{path}.replace_extension(".bin")};
+  if (!meta || !bin)
+  {
+    spdlog::error("Baked scene {} is incomplete, did you run model_bakery_baker?", path);
+    return std::nullopt;
+  }
+
+  const auto metaData = meta.getData();
+  const auto binData = bin.getData();
+
+  BakedSceneHeader header;
+  if (metaData.size() < sizeof(header))
+  {
+    spdlog::error("Baked scene {} has a truncated header!", path);
+    return std::nullopt;
+  }
+  std::memcpy(&header, metaData.data(), sizeof(header));
+
+  if (header.magic != BAKED_SCENE_MAGIC || header.version != BAKED_SCENE_VERSION)
+  {
+    spdlog::error(
+      "Baked scene {} has version {}, but version {} was expected. Re-bake the scene!",
+      path,
+      header.magic == BAKED_SCENE_MAGIC ? header.version : 0,
+      BAKED_SCENE_VERSION);
+    return std::nullopt;
+  }
+
+  const std::size_t relemsOffset = sizeof(BakedSceneHeader);
+  const std::size_t lodsOffset = relemsOffset + header.relemCount * sizeof(BakedRenderElement);
+  const std::size_t boundsOffset = lodsOffset + header.lodCount * sizeof(BakedRenderElementLod);
+  const std::size_t meshesOffset =
+    boundsOffset + header.relemCount * sizeof(BakedRenderElementBounds);
+  const std::size_t matricesOffset = meshesOffset + header.meshCount * sizeof(BakedMesh);
+  const std::size_t instMeshesOffset = matricesOffset + header.instanceCount * sizeof(glm::mat4x4);
+  const std::size_t metaSize = instMeshesOffset + header.instanceCount * sizeof(std::uint32_t);
+
+  const std::size_t vertexBytes = header.vertexCount * sizeof(BakedVertex);
+  const std::size_t indexBytes = header.indexCount * sizeof(std::uint32_t);
+
+  if (
+    metaData.size() != metaSize || header.vertexByteOffset + vertexBytes > binData.size() ||
+    header.indexByteOffset + indexBytes > binData.size() ||
+    header.indexByteOffset % alignof(std::uint32_t) != 0)
+  {
+    spdlog::error("Baked scene {} does not match its header, re-bake the scene!", path);
+    return std::nullopt;
+  }
+
+  // Tables are tiny compared to the vertex data, so copying them is fine
+  const auto copyTable =
+    [&metaData]<class T>(std::vector<T>& dst, std::size_t offset, std::size_t count) {
+      dst.resize(count);
+      std::memcpy(dst.data(), metaData.data() + offset, count * sizeof(T));
+    };
+
+  SceneData result;
+
+  static_assert(sizeof(RenderElement) == sizeof(BakedRenderElement));
+  static_assert(sizeof(RenderElementLod) == sizeof(BakedRenderElementLod));
+  static_assert(sizeof(RenderElementBounds) == sizeof(BakedRenderElementBounds));
+  static_assert(sizeof(Mesh) == sizeof(BakedMesh));
+  copyTable(result.relems, relemsOffset, header.relemCount);
+  copyTable(result.lods, lodsOffset, header.lodCount);
+  copyTable(result.bounds, boundsOffset, header.relemCount);
+  copyTable(result.meshes, meshesOffset, header.meshCount);
+  copyTable(result.instanceMatrices, matricesOffset, header.instanceCount);
+  copyTable(result.instanceMeshes, instMeshesOffset, header.instanceCount);
+
+  // Vertices and indices are not copied anywhere, they go straight from the page cache
+  // into the staging buffer. mmap-ed memory is page-aligned, so the indices are aligned.
+  result.vertices = binData.subspan(header.vertexByteOffset, vertexBytes);
+  result.indices = {
+    reinterpret_cast<const std::uint32_t*>(binData.data() + header.indexByteOffset),
+    header.indexCount};
+  result.bin = std::move(bin);
+
+  if (positionStream)
+  {
+    // NOTE: this reads every page of the vertex data, but on the loading thread
+    result.positions.resize(header.vertexCount);
+    for (std::size_t i = 0; i < header.vertexCount; ++i)
+      std::memcpy(
+        &result.positions[i],
+        result.vertices.data() + i * sizeof(BakedVertex) + offsetof(BakedVertex, position),
+        sizeof(glm::vec3));
+  }
+
+  groupInstancesByMesh(result);
+  computeInstanceSpheres(result);
+  computeNormalMatrices(result);
+
+  return result;
+}
+
+void SceneManager::groupInstancesByMesh(SceneData& data)
+{
+  // Counting sort, instances of the same mesh keep their relative order
+  auto& ranges = data.meshInstances;
+  ranges.assign(data.meshes.size(), MeshInstances{0, 0});
+  for (const std::uint32_t meshIdx : data.instanceMeshes)
+    ++ranges[meshIdx].instanceCount;
+
+  std::uint32_t firstInstance = 0;
+  for (auto& range : ranges)
+  {
+    range.firstInstance = firstInstance;
+    firstInstance += range.instanceCount;
+  }
+
+  std::vector<glm::mat4x4> matrices(data.instanceMatrices.size());
+  std::vector<std::uint32_t> instanceMeshes(data.instanceMeshes.size());
+  std::vector<std::uint32_t> written(data.meshes.size(), 0);
+  for (std::size_t instIdx = 0; instIdx < data.instanceMeshes.size(); ++instIdx)
+  {
+    const std::uint32_t meshIdx = data.instanceMeshes[instIdx];
+    const std::uint32_t dst = ranges[meshIdx].firstInstance + written[meshIdx]++;
+    matrices[dst] = data.instanceMatrices[instIdx];
+    instanceMeshes[dst] = meshIdx;
+  }
+
+  data.instanceMatrices = std::move(matrices);
+  data.instanceMeshes = std::move(instanceMeshes);
+}
+
+// World-space bounding sphere of an instance of a mesh with the bounding sphere `mesh_sphere`
+static glm::vec4 instance_sphere(const glm::mat4x4& m, glm::vec4 mesh_sphere)
+{
+  const float scale = std::max(
+    {glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+  return glm::vec4(glm::vec3(m * glm::vec4(glm::vec3(mesh_sphere), 1.0f)), mesh_sphere.w * scale);
+}
+
+// NOTE: shaders renormalize normals after the transform, so normal matrices only
+// have to be right up to a positive scale. There are no branches besides the fast path,
+// so loops over contiguous arrays of matrices calling this are vectorized well.
+static glm::mat3x4 normal_matrix(const glm::mat4x4& m)
+{
+  const glm::vec3 c0{m[0]};
+  const glm::vec3 c1{m[1]};
+  const glm::vec3 c2{m[2]};
+
+  // Rotation times uniform scale (possibly a negative one) is its own normal matrix
+  // up to a scale, which covers the vast majority of instances in real scenes.
+  const float len2 = glm::dot(c0, c0);
+  const float eps = 1e-5f * len2;
+  const bool uniformScale = std::abs(glm::dot(c1, c1) - len2) <= eps
+    && std::abs(glm::dot(c2, c2) - len2) <= eps && std::abs(glm::dot(c0, c1)) <= eps
+    && std::abs(glm::dot(c1, c2)) <= eps && std::abs(glm::dot(c2, c0)) <= eps;
+  if (uniformScale)
+    return glm::mat3x4(m[0], m[1], m[2]);
+
+  // Columns of the inverse transpose are cross products of the columns divided
+  // by the determinant. Only its sign matters here, it flips mirrored instances.
+  const glm::vec3 r0 = glm::cross(c1, c2);
+  const glm::vec3 r1 = glm::cross(c2, c0);
+  const glm::vec3 r2 = glm::cross(c0, c1);
+  const float detSign = glm::dot(c0, r0) < 0 ? -1.0f : 1.0f;
+  return glm::mat3x4(
+    glm::vec4(r0 * detSign, 0.0f), glm::vec4(r1 * detSign, 0.0f), glm::vec4(r2 * detSign, 0.0f));
+}
+
+void SceneManager::computeInstanceSpheres(SceneData& data)
+{
+  // Mesh spheres enclose the spheres of their relems
+  auto& meshSpheres = data.meshSpheres;
+  meshSpheres.assign(data.meshes.size(), glm::vec4{0.0f});
+  for (std::size_t meshIdx = 0; meshIdx < data.meshes.size(); ++meshIdx)
+  {
+    const auto& mesh = data.meshes[meshIdx];
+    const auto relemBounds = std::span{data.bounds}.subspan(mesh.firstRelem, mesh.relemCount);
+    if (relemBounds.empty())
+      continue;
+
+    glm::vec3 aabbMin{std::numeric_limits<float>::max()};
+    glm::vec3 aabbMax{std::numeric_limits<float>::lowest()};
+    for (const auto& bounds : relemBounds)
+    {
+      aabbMin = glm::min(aabbMin, bounds.aabbMin);
+      aabbMax = glm::max(aabbMax, bounds.aabbMax);
+    }
+
+    const glm::vec3 center = (aabbMin + aabbMax) * 0.5f;
+    float radius = 0;
+    for (const auto& bounds : relemBounds)
+      radius = std::max(radius, glm::distance(center, bounds.sphereCenter) + bounds.sphereRadius);
+
+    meshSpheres[meshIdx] = glm::vec4(center, radius);
+  }
+
+  // World-space spheres are only recomputed for instances that move later on
+  data.instanceSpheres = {};
+  for (std::size_t instIdx = 0; instIdx < data.instanceMatrices.size(); ++instIdx)
+  {
+    const glm::vec4 sphere = instance_sphere(
+      data.instanceMatrices[instIdx], meshSpheres[data.instanceMeshes[instIdx]]);
+    data.instanceSpheres.push_back(glm::vec3(sphere), sphere.w);
+  }
+}
+
+void SceneManager::computeNormalMatrices(SceneData& data)
+{
+  auto& normalMatrices = data.instanceNormalMatrices;
+  normalMatrices.resize(data.instanceMatrices.size());
+  for (std::size_t instIdx = 0; instIdx < data.instanceMatrices.size(); ++instIdx)
+    normalMatrices[instIdx] = normal_matrix(data.instanceMatrices[instIdx]);
+}
+
+void SceneManager::applySceneData(SceneData data)
+{
   // By aggregating all SceneManager fields mutations here,
   // we guarantee that we don't forget to clear something
   // when re-loading a scene.
+  renderElements = std::move(data.relems);
+  renderElementLods = std::move(data.lods);
+  renderElementBounds = std::move(data.bounds);
+  meshes = std::move(data.meshes);
+  instanceMatrices = std::move(data.instanceMatrices);
+  instanceNormalMatrices = std::move(data.instanceNormalMatrices);
+  instanceMeshes = std::move(data.instanceMeshes);
+  meshInstances = std::move(data.meshInstances);
+  meshSpheres = std::move(data.meshSpheres);
+  instanceSpheres = std::move(data.instanceSpheres);
+
+  movedInstances.clear();
+  movedInstanceSlots.assign(instanceMatrices.size(), ~0u);
+
+  relemInstanceCount = 0;
+  for (const std::uint32_t meshIdx : instanceMeshes)
+    relemInstanceCount += meshes[meshIdx].relemCount;
+}
 
-  // NOTE: you might want to store these on the GPU for GPU-driven rendering.
-  auto [instMats, instMeshes] = processInstances(model);
-  instanceMatrices = std::move(instMats);
-  instanceMeshes = std::move(instMeshes);
+void SceneManager::setInstanceMatrix(std::uint32_t instance, const glm::mat4x4& matrix)
+{
+  if (movedInstanceSlots[instance] == ~0u)
+  {
+    movedInstanceSlots[instance] = static_cast<std::uint32_t>(movedInstances.size());
+    movedInstances.push_back(MovedInstance{
+      .instance = instance,
+      .oldSphere = instanceSpheres.get(instance),
+    });
+  }
+
+  instanceMatrices[instance] = matrix;
+  instanceNormalMatrices[instance] = normal_matrix(matrix);
 
-  auto [verts, inds, relems, meshs] = processMeshes(model);
+  const glm::vec4 sphere = instance_sphere(matrix, meshSpheres[instanceMeshes[instance]]);
+  instanceSpheres.set(instance, glm::vec3(sphere), sphere.w);
+}
 
-  renderElements = std::move(relems);
-  meshes = std::move(meshs);
+void SceneManager::recordInstanceUpdates(vk::CommandBuffer cmd_buf)
+{
+  if (movedInstances.empty())
+    return;
+
+  const vk::PipelineStageFlags2 readStages =
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eComputeShader;
+
+  // Frames in flight and culling may still read the old matrices
+  const vk::MemoryBarrier2 beforeUpdate{
+    .srcStageMask = readStages,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+    .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &beforeUpdate,
+  });
+
+  // NOTE: only a handful of instances move per frame in practice, so inline updates
+  // are cheaper than going through the staging ring and synchronizing with it.
+  for (const auto& moved : movedInstances)
+  {
+    cmd_buf.updateBuffer(
+      buffers.instanceMatrices.get(),
+      moved.instance * sizeof(glm::mat4x4),
+      sizeof(glm::mat4x4),
+      &instanceMatrices[moved.instance]);
+    cmd_buf.updateBuffer(
+      buffers.instanceNormalMatrices.get(),
+      moved.instance * sizeof(glm::mat3x4),
+      sizeof(glm::mat3x4),
+      &instanceNormalMatrices[moved.instance]);
+  }
+
+  const vk::MemoryBarrier2 afterUpdate{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = readStages,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &afterUpdate,
+  });
 
-  uploadData(verts, inds);
+  // NOTE: not in update, a frame that is skipped (e.g. on a failed acquire) records
+  // no updates, so its moves must stay in the list until the next recorded frame.
+  for (const auto& moved : movedInstances)
+    movedInstanceSlots[moved.instance] = ~0u;
+  movedInstances.clear();
+}
+
+void SceneManager::selectScene(std::filesystem::path path)
+{
+  ZoneScoped;
+
+  auto data = loadSceneData(path);
+  if (!data.has_value())
+    return;
+
+  uploadSceneData(std::move(*data), path);
+}
+
+void SceneManager::selectBakedScene(std::filesystem::path path)
+{
+  ZoneScoped;
+
+  auto data = loadBakedSceneData(path);
+  if (!data.has_value())
+    return;
+
+  uploadSceneData(std::move(*data), path);
+}
+
+void SceneManager::uploadSceneData(SceneData data, const std::filesystem::path& path)
+{
+  using Clock = std::chrono::steady_clock;
+  using Ms = std::chrono::duration<double, std::milli>;
+
+  const auto uploadStart = Clock::now();
+
+  buffers = createBuffers(data);
+
+  std::size_t totalBytes = 0;
+  for (const auto& [buffer, source] : getBufferSources(buffers, data))
+  {
+    uploader.upload(buffer->get(), 0, source);
+    totalBytes += source.size();
+  }
+  uploader.wait(uploader.flush());
+
+  const auto uploadEnd = Clock::now();
+
+  spdlog::info(
+    "Scene {}: uploaded {:.1f} MB in {:.1f} ms ({:.0f} MB/s)",
+    path,
+    static_cast<double>(totalBytes) / 1e6,
+    Ms(uploadEnd - uploadStart).count(),
+    static_cast<double>(totalBytes) / 1e3 / std::max(Ms(uploadEnd - uploadStart).count(), 1e-3));
+
+  applySceneData(std::move(data));
+}
+
+void SceneManager::selectSceneAsync(std::filesystem::path path)
+{
+  startLoading(std::move(path), false);
+}
+
+void SceneManager::selectBakedSceneAsync(std::filesystem::path path)
+{
+  startLoading(std::move(path), true);
+}
+
+void SceneManager::startLoading(std::filesystem::path path, bool baked)
+{
+  if (isLoading())
+  {
+    spdlog::warn("Scene {} was not loaded, another scene is being loaded already!", path);
+    return;
+  }
+
+  loadingScene = std::async(std::launch::async, [this, path, baked]() {
+    auto data = baked ? loadBakedSceneData(path) : loadSceneData(path);
+    if (!data.has_value())
+      return std::optional<PendingScene>{};
+
+    return std::optional<PendingScene>{createSceneBuffers(std::move(*data))};
+  });
+}
+
+SceneManager::PendingScene SceneManager::createSceneBuffers(SceneData data) const
+{
+  ZoneScoped;
+
+  // NOTE: this runs on the loading thread. Creating buffers is fine there, as VMA
+  // is thread-safe, but all submits still have to happen on the render thread,
+  // as the queue is not ours to synchronize.
+  PendingScene result;
+  result.buffers = createBuffers(data);
+
+  // Get the pages of the baked file into memory before the render thread reads them
+  data.bin.prefetch();
+
+  result.data = std::move(data);
+
+  return result;
+}
+
+// The render thread only spends this many bytes of memcpy per frame on uploads
+static constexpr std::size_t UPLOAD_BUDGET_PER_FRAME = 16 * 1024 * 1024;
+
+bool SceneManager::streamPendingScene(PendingScene& scene)
+{
+  ZoneScoped;
+
+  std::size_t budget = UPLOAD_BUDGET_PER_FRAME;
+  bool done = true;
+
+  const auto sources = getBufferSources(scene.buffers, scene.data);
+  for (std::size_t i = 0; i < SCENE_BUFFER_COUNT; ++i)
+  {
+    const auto& [dst, src] = sources[i];
+    std::size_t& streamed = scene.bytesStreamed[i];
+
+    const auto part = src.subspan(streamed, std::min(budget, src.size() - streamed));
+    const std::size_t consumed = uploader.tryUpload(dst->get(), streamed, part);
+    streamed += consumed;
+    budget -= consumed;
+    done = done && streamed == src.size();
+  }
+
+  // Let the GPU start copying right away instead of waiting for the chunk to fill up
+  uploader.flush();
+
+  return done;
+}
+
+bool SceneManager::isLoading() const
+{
+  return loadingScene.valid() || uploadingScene.has_value();
+}
+
+bool SceneManager::update()
+{
+  ZoneScoped;
+
+  ++frameIndex;
+
+  while (!retiredBuffers.empty() && retiredBuffers.front().releaseFrame <= frameIndex)
+    retiredBuffers.pop_front();
+
+  if (
+    loadingScene.valid() &&
+    loadingScene.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+  {
+    uploadingScene = loadingScene.get();
+    if (uploadingScene.has_value())
+      uploadingScene->uploadStart = std::chrono::steady_clock::now();
+  }
+
+  if (!uploadingScene.has_value())
+    return false;
+
+  auto& scene = *uploadingScene;
+
+  if (!scene.uploadTicket.has_value())
+  {
+    if (!streamPendingScene(scene))
+      return false;
+    scene.uploadTicket = uploader.flush();
+  }
+
+  if (!uploader.isDone(*scene.uploadTicket))
+    return false;
+
+  std::size_t totalBytes = 0;
+  for (const std::size_t bytes : scene.bytesStreamed)
+    totalBytes += bytes;
+  const double uploadMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - scene.uploadStart)
+                            .count();
+  spdlog::info(
+    "Scene streamed in: {:.1f} MB in {:.1f} ms ({:.0f} MB/s), swapped in at frame {}",
+    static_cast<double>(totalBytes) / 1e6,
+    uploadMs,
+    static_cast<double>(totalBytes) / 1e3 / std::max(uploadMs, 1e-3),
+    frameIndex);
+
+  // Frames which are still in flight may use the old buffers, so they are
+  // only freed after the last one of those frames is done.
+  retiredBuffers.push_back(RetiredBuffers{
+    .releaseFrame = frameIndex + etna::get_context().getMainWorkCount().multiBufferingCount(),
+    .buffers = std::move(buffers),
+  });
+
+  buffers = std::move(scene.buffers);
+  applySceneData(std::move(scene.data));
+
+  uploadingScene.reset();
+
+  return true;
 }
 
 etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
@@ -411,3 +979,39 @@ etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription
       },
     }};
 }
+
+etna::VertexByteStreamFormatDescription SceneManager::getBakedVertexFormatDescription()
+{
+  return etna::VertexByteStreamFormatDescription{
+    .stride = sizeof(BakedVertex),
+    .attributes = {
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32B32Sfloat,
+        .offset = offsetof(BakedVertex, position),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR8G8B8A8Snorm,
+        .offset = offsetof(BakedVertex, normal),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32Sfloat,
+        .offset = offsetof(BakedVertex, texcoord),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR8G8B8A8Snorm,
+        .offset = offsetof(BakedVertex, tangent),
+      },
+    }};
+}
+
+etna::VertexByteStreamFormatDescription SceneManager::getPositionFormatDescription()
+{
+  return etna::VertexByteStreamFormatDescription{
+    .stride = sizeof(glm::vec3),
+    .attributes = {
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32B32Sfloat,
+        .offset = 0,
+      },
+    }};
+}
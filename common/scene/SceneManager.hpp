@@ -1,13 +1,20 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <deque>
 #include <filesystem>
+#include <future>
 
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 #include <etna/Buffer.hpp>
-#include <etna/BlockingTransferHelper.hpp>
 #include <etna/VertexInput.hpp>
 
+#include "FrustumCulling.hpp"
+#include "MappedFile.hpp"
+#include "StreamingUploader.hpp"
+
 
 // A single render element (relem) corresponds to a single draw call
 // of a certain pipeline with specific bindings (including material data)
@@ -16,10 +23,33 @@ struct RenderElement
   std::uint32_t vertexOffset;
   std::uint32_t indexOffset;
   std::uint32_t indexCount;
+  // Range of LODs of this relem, see RenderElementLod
+  std::uint32_t firstLod;
+  std::uint32_t lodCount;
   // Not implemented!
   // Material* material;
 };
 
+// A simplified version of a relem which uses the same vertices. LOD 0 is the relem
+// itself, and the following LODs have increasing errors. The error is the distance
+// between the simplified and the original surface in mesh space, so the LOD to draw
+// is the coarsest one whose error projected on the screen is still below a pixel or so.
+struct RenderElementLod
+{
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  float error;
+};
+
+// Mesh-space bounds of the vertices of a relem, the sphere is centered at the AABB center
+struct RenderElementBounds
+{
+  glm::vec3 aabbMin;
+  glm::vec3 aabbMax;
+  glm::vec3 sphereCenter;
+  float sphereRadius;
+};
+
 // A mesh is a collection of relems. A scene may have the same mesh
 // located in several different places, so a scene consists of **instances**,
 // not meshes.
@@ -29,40 +59,123 @@ struct Mesh
   std::uint32_t relemCount;
 };
 
+// Instances are sorted by mesh, so all instances of a mesh form a contiguous range
+// and can be drawn with a single instanced draw call per relem.
+struct MeshInstances
+{
+  std::uint32_t firstInstance;
+  std::uint32_t instanceCount;
+};
+
+// An instance that was moved with SceneManager::setInstanceMatrix
+struct MovedInstance
+{
+  std::uint32_t instance;
+  // World-space bounding sphere before the move as vec4(center, radius)
+  glm::vec4 oldSphere;
+};
+
 class SceneManager
 {
 public:
+  struct CreateInfo
+  {
+    // Also keep a tightly packed copy of vertex positions on the GPU, see getPositionBuffer
+    bool positionStream = false;
+  };
+
   SceneManager();
+  explicit SceneManager(const CreateInfo& info);
+  ~SceneManager();
 
   void selectScene(std::filesystem::path path);
 
+  // Loads a scene produced by model_bakery_baker, `path` is the `_baked.gltf` file.
+  // The glTF itself is not parsed, the .bin and .meta files next to it are
+  // mapped into memory and uploaded to the GPU as is.
+  void selectBakedScene(std::filesystem::path path);
+
+  // Same as the above, but files are loaded and processed on a background thread,
+  // while the current scene stays available. The new scene replaces the current one
+  // inside of one of the following `update` calls, once it's uploaded to the GPU.
+  // Only one scene can be loaded at a time, don't call selectScene meanwhile.
+  void selectSceneAsync(std::filesystem::path path);
+  void selectBakedSceneAsync(std::filesystem::path path);
+  bool isLoading() const;
+
+  // Has to be called on the render thread once per frame, before anything using
+  // the scene is recorded. Swaps in asynchronously loaded scenes and frees the
+  // buffers of replaced ones after all frames in flight are done with them.
+  // Returns true if the scene was replaced.
+  bool update();
+
   // Every instance is a mesh drawn with a certain transform
   // NOTE: maybe you can pass some additional data through unused matrix entries?
   std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
 
+  // Range of instances of every mesh, see MeshInstances
+  std::span<const MeshInstances> getMeshInstances() { return meshInstances; }
+
+  // Moves an instance, its bounding sphere is updated right away. The GPU copies of
+  // the matrices are updated by recordInstanceUpdates.
+  void setInstanceMatrix(std::uint32_t instance, const glm::mat4x4& matrix);
+
+  // Instances moved since the last recordInstanceUpdates call, each one is listed once
+  std::span<const MovedInstance> getMovedInstances() { return movedInstances; }
+
+  // Records copies of the matrices of moved instances into the instance buffers,
+  // with barriers against both earlier and later shader reads. Has to be recorded
+  // before anything that uses the instance buffers in the frame. Empties getMovedInstances.
+  void recordInstanceUpdates(vk::CommandBuffer cmd_buf);
+
   // Every mesh is a collection of relems
   std::span<const Mesh> getMeshes() { return meshes; }
 
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
-  vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
-  vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
+  // Only baked scenes have LODs, other scenes have a single LOD per relem
+  std::span<const RenderElementLod> getRenderElementLods() { return renderElementLods; }
+
+  // Bounds of every relem, computed at load time
+  std::span<const RenderElementBounds> getRenderElementBounds() { return renderElementBounds; }
+
+  // World-space bounding spheres of all instances, in the same order as the instances
+  const BoundingSpheres& getInstanceBoundingSpheres() { return instanceSpheres; }
+
+  vk::Buffer getVertexBuffer() { return buffers.vertices.get(); }
+  vk::Buffer getIndexBuffer() { return buffers.indices.get(); }
+
+  // Only positions of the vertices of the vertex buffer as 3 floats, for passes that
+  // don't need any other attributes like shadows and depth prepasses. Uses the same
+  // indices and vertex offsets. Null unless CreateInfo::positionStream was set.
+  vk::Buffer getPositionBuffer() { return positionStream ? buffers.positions.get() : nullptr; }
+
+  // The same tables as above in storage buffers, for GPU-driven rendering. Structs are
+  // laid out the same way as in std430 GLSL blocks made of uint, float, vec4 and mat4 fields.
+  const etna::Buffer& getInstanceMatricesBuffer() { return buffers.instanceMatrices; }
+  // Inverse transposed upper 3x3 of instance matrices as mat3x4, up to a scale
+  const etna::Buffer& getInstanceNormalMatricesBuffer() { return buffers.instanceNormalMatrices; }
+  const etna::Buffer& getInstanceMeshesBuffer() { return buffers.instanceMeshes; }
+  const etna::Buffer& getMeshesBuffer() { return buffers.meshes; }
+  const etna::Buffer& getRenderElementsBuffer() { return buffers.relems; }
+  const etna::Buffer& getRenderElementLodsBuffer() { return buffers.lods; }
+  // Mesh-space bounding spheres of meshes as vec4(center, radius)
+  const etna::Buffer& getMeshSpheresBuffer() { return buffers.meshSpheres; }
+
+  // Sum of relem counts of all instances, i.e. the max amount of draws per view
+  std::uint32_t getRelemInstanceCount() { return relemInstanceCount; }
 
   etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  // Format of the vertex buffer after selectBakedScene, see BakedVertex
+  etna::VertexByteStreamFormatDescription getBakedVertexFormatDescription();
+  // Format of the position buffer, regardless of the kind of the scene
+  etna::VertexByteStreamFormatDescription getPositionFormatDescription();
 
 private:
   std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
 
-  struct ProcessedInstances
-  {
-    std::vector<glm::mat4x4> matrices;
-    std::vector<std::uint32_t> meshes;
-  };
-
-  ProcessedInstances processInstances(const tinygltf::Model& model) const;
-
   struct Vertex
   {
     // First 3 floats are position, 4th float is a packed normal
@@ -78,21 +191,119 @@ private:
     std::vector<Vertex> vertices;
     std::vector<std::uint32_t> indices;
     std::vector<RenderElement> relems;
+    std::vector<RenderElementLod> lods;
+    std::vector<RenderElementBounds> bounds;
     std::vector<Mesh> meshes;
   };
   ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+
+  // Everything a scene consists of, loaded into CPU memory
+  struct SceneData
+  {
+    std::vector<RenderElement> relems;
+    std::vector<RenderElementLod> lods;
+    std::vector<RenderElementBounds> bounds;
+    std::vector<Mesh> meshes;
+    std::vector<glm::mat4x4> instanceMatrices;
+    std::vector<glm::mat3x4> instanceNormalMatrices;
+    std::vector<std::uint32_t> instanceMeshes;
+    std::vector<MeshInstances> meshInstances;
+    std::vector<glm::vec4> meshSpheres;
+    BoundingSpheres instanceSpheres;
+
+    // Point either into the storage vectors or into the mapped .bin file
+    std::span<const std::byte> vertices;
+    std::span<const std::uint32_t> indices;
+
+    std::vector<glm::vec3> positions;
+
+    std::vector<Vertex> vertexStorage;
+    std::vector<std::uint32_t> indexStorage;
+    MappedFile bin;
+  };
+
+  // These are called from the loading thread too
+  std::optional<SceneData> loadSceneData(std::filesystem::path path);
+  std::optional<SceneData> loadBakedSceneData(std::filesystem::path path);
+
+  static void groupInstancesByMesh(SceneData& data);
+  static void computeInstanceSpheres(SceneData& data);
+  static void computeNormalMatrices(SceneData& data);
+
+  // Everything a scene has on the GPU
+  struct SceneBuffers
+  {
+    etna::Buffer vertices;
+    etna::Buffer indices;
+    etna::Buffer positions;
+    etna::Buffer instanceMatrices;
+    etna::Buffer instanceNormalMatrices;
+    etna::Buffer instanceMeshes;
+    etna::Buffer meshes;
+    etna::Buffer meshSpheres;
+    etna::Buffer relems;
+    etna::Buffer lods;
+  };
+
+  static constexpr std::size_t SCENE_BUFFER_COUNT = 10;
+
+  // Every buffer paired with the data it is filled with
+  using SceneBufferSources =
+    std::array<std::pair<etna::Buffer*, std::span<const std::byte>>, SCENE_BUFFER_COUNT>;
+  static SceneBufferSources getBufferSources(SceneBuffers& buffers, const SceneData& data);
+  static SceneBuffers createBuffers(const SceneData& data);
+
+  void uploadSceneData(SceneData data, const std::filesystem::path& path);
+  void applySceneData(SceneData data);
+
+  // A scene that was loaded asynchronously, but is not visible yet
+  struct PendingScene
+  {
+    // Vertex data is kept alive until it's streamed to the GPU
+    SceneData data;
+    SceneBuffers buffers;
+    std::array<std::size_t, SCENE_BUFFER_COUNT> bytesStreamed{};
+    std::optional<std::uint64_t> uploadTicket;
+    std::chrono::steady_clock::time_point uploadStart;
+  };
+
+  void startLoading(std::filesystem::path path, bool baked);
+  PendingScene createSceneBuffers(SceneData data) const;
+  bool streamPendingScene(PendingScene& scene);
 
 private:
+  bool positionStream;
+
   tinygltf::TinyGLTF loader;
-  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
-  etna::BlockingTransferHelper transferHelper;
+  StreamingUploader uploader;
 
   std::vector<RenderElement> renderElements;
+  std::vector<RenderElementLod> renderElementLods;
+  std::vector<RenderElementBounds> renderElementBounds;
   std::vector<Mesh> meshes;
   std::vector<glm::mat4x4> instanceMatrices;
+  std::vector<glm::mat3x4> instanceNormalMatrices;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<MeshInstances> meshInstances;
+  std::vector<glm::vec4> meshSpheres;
+  BoundingSpheres instanceSpheres;
+
+  std::vector<MovedInstance> movedInstances;
+  // Index of every instance in movedInstances, or ~0u if it did not move
+  std::vector<std::uint32_t> movedInstanceSlots;
+
+  SceneBuffers buffers;
+  std::uint32_t relemInstanceCount = 0;
+
+  std::future<std::optional<PendingScene>> loadingScene;
+  std::optional<PendingScene> uploadingScene;
+
+  struct RetiredBuffers
+  {
+    std::uint64_t releaseFrame;
+    SceneBuffers buffers;
+  };
 
-  etna::Buffer unifiedVbuf;
-  etna::Buffer unifiedIbuf;
+  std::deque<RetiredBuffers> retiredBuffers;
+  std::uint64_t frameIndex = 0;
 };
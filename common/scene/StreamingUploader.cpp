@@ -0,0 +1,213 @@
+#include "StreamingUploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Profiling.hpp>
+
+
+StreamingUploader::StreamingUploader(CreateInfo info)
+  : chunkSize{info.ringSize / std::max(info.chunkCount, 1u)}
+{
+  ETNA_VERIFY(info.chunkCount > 0 && chunkSize > 0);
+
+  auto& ctx = etna::get_context();
+  const vk::Device device = ctx.getDevice();
+
+  ring = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = chunkSize * info.chunkCount,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "streaming_uploader_ring",
+  });
+
+  // Stays mapped for the whole lifetime of the uploader
+  ringData = ring.map();
+
+  commandPool = etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+  }));
+
+  auto cmdBufs =
+    etna::unwrap_vk_result(device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+      .commandPool = commandPool.get(),
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = info.chunkCount,
+    }));
+
+  chunks.resize(info.chunkCount);
+  for (std::size_t i = 0; i < chunks.size(); ++i)
+  {
+    chunks[i].cmdBuf = std::move(cmdBufs[i]);
+    // Signaled, so that free chunks don't need special treatment
+    chunks[i].fence = etna::unwrap_vk_result(device.createFenceUnique(vk::FenceCreateInfo{
+      .flags = vk::FenceCreateFlagBits::eSignaled,
+    }));
+  }
+}
+
+StreamingUploader::~StreamingUploader()
+{
+  waitIdle();
+  ring.unmap();
+}
+
+void StreamingUploader::upload(
+  vk::Buffer dst, vk::DeviceSize dst_offset, std::span<const std::byte> src)
+{
+  stream(dst, dst_offset, src, true);
+}
+
+std::size_t StreamingUploader::tryUpload(
+  vk::Buffer dst, vk::DeviceSize dst_offset, std::span<const std::byte> src)
+{
+  return stream(dst, dst_offset, src, false);
+}
+
+std::size_t StreamingUploader::stream(
+  vk::Buffer dst, vk::DeviceSize dst_offset, std::span<const std::byte> src, bool may_wait)
+{
+  ZoneScoped;
+
+  std::size_t consumed = 0;
+  while (consumed < src.size())
+  {
+    if (!acquireChunk(may_wait))
+      break;
+
+    auto& chunk = chunks[current];
+
+    const auto piece = static_cast<std::size_t>(
+      std::min<vk::DeviceSize>(chunkSize - chunk.used, src.size() - consumed));
+    const vk::DeviceSize ringOffset = current * chunkSize + chunk.used;
+
+    std::memcpy(ringData + ringOffset, src.data() + consumed, piece);
+    chunk.cmdBuf->copyBuffer(
+      ring.get(),
+      dst,
+      {vk::BufferCopy{
+        .srcOffset = ringOffset,
+        .dstOffset = dst_offset + consumed,
+        .size = piece,
+      }});
+
+    chunk.used += piece;
+    consumed += piece;
+    bytesUploaded += piece;
+
+    if (chunk.used == chunkSize)
+      submitChunk();
+  }
+
+  return consumed;
+}
+
+bool StreamingUploader::acquireChunk(bool may_wait)
+{
+  auto& chunk = chunks[current];
+  if (chunk.recording)
+    return true;
+
+  const vk::Device device = etna::get_context().getDevice();
+
+  // The GPU might still be copying out of this part of the ring
+  if (may_wait)
+  {
+    ZoneScopedN("waitForRing");
+    ETNA_CHECK_VK_RESULT(device.waitForFences(
+      {chunk.fence.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+  }
+  else
+  {
+    const vk::Result status = device.getFenceStatus(chunk.fence.get());
+    if (status == vk::Result::eNotReady)
+      return false;
+    ETNA_CHECK_VK_RESULT(status);
+  }
+
+  ETNA_CHECK_VK_RESULT(device.resetFences({chunk.fence.get()}));
+  ETNA_CHECK_VK_RESULT(chunk.cmdBuf->begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+
+  chunk.used = 0;
+  chunk.recording = true;
+
+  return true;
+}
+
+void StreamingUploader::submitChunk()
+{
+  ZoneScoped;
+
+  auto& chunk = chunks[current];
+  const vk::CommandBuffer cmdBuf = chunk.cmdBuf.get();
+
+  // Everything submitted to the queue after this point sees the uploaded data
+  const vk::MemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    .dstAccessMask = vk::AccessFlagBits2::eMemoryRead,
+  };
+  cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+  const vk::SubmitInfo submitInfo{
+    .commandBufferCount = 1,
+    .pCommandBuffers = &cmdBuf,
+  };
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit({submitInfo}, chunk.fence.get()));
+
+  chunk.recording = false;
+  chunk.ticket = ++lastTicket;
+  current = (current + 1) % chunks.size();
+}
+
+std::uint64_t StreamingUploader::flush()
+{
+  if (chunks[current].recording)
+    submitChunk();
+  return lastTicket;
+}
+
+// NOTE: a chunk is only reused after its fence has signaled, so if a chunk's
+// latest ticket is newer than the one we are interested in, all of its
+// older submits are done already.
+bool StreamingUploader::isDone(std::uint64_t ticket) const
+{
+  const vk::Device device = etna::get_context().getDevice();
+  for (const auto& chunk : chunks)
+  {
+    if (chunk.recording || chunk.ticket == 0 || chunk.ticket > ticket)
+      continue;
+
+    const vk::Result status = device.getFenceStatus(chunk.fence.get());
+    if (status == vk::Result::eNotReady)
+      return false;
+    ETNA_CHECK_VK_RESULT(status);
+  }
+  return true;
+}
+
+void StreamingUploader::wait(std::uint64_t ticket) const
+{
+  ZoneScoped;
+
+  const vk::Device device = etna::get_context().getDevice();
+  for (const auto& chunk : chunks)
+  {
+    if (chunk.recording || chunk.ticket == 0 || chunk.ticket > ticket)
+      continue;
+
+    ETNA_CHECK_VK_RESULT(device.waitForFences(
+      {chunk.fence.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+  }
+}
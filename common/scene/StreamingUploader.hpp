@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Uploads data to GPU buffers through a persistently mapped staging ring.
+ * The ring is split into equal chunks, each one with its own command buffer and fence.
+ * While the GPU copies out of one chunk, the CPU is already filling the next one,
+ * so up to `chunkCount` transfers are in flight at the same time. Uploads larger
+ * than the ring are streamed through it piece by piece.
+ *
+ * Copies are submitted to the main etna queue, as etna creates no dedicated transfer
+ * queue. A barrier at the end of every submit makes the data visible to everything
+ * that is submitted to that queue afterwards.
+ */
+class StreamingUploader
+{
+public:
+  struct CreateInfo
+  {
+    vk::DeviceSize ringSize = 64 * 1024 * 1024;
+    std::uint32_t chunkCount = 4;
+  };
+
+  explicit StreamingUploader(CreateInfo info);
+  ~StreamingUploader();
+
+  StreamingUploader(const StreamingUploader&) = delete;
+  StreamingUploader& operator=(const StreamingUploader&) = delete;
+
+  // Copies `src` into `dst` starting at `dst_offset`. Only waits for the GPU
+  // when all chunks of the ring are busy. Use `flush` to submit the last chunk.
+  void upload(vk::Buffer dst, vk::DeviceSize dst_offset, std::span<const std::byte> src);
+
+  // Same, but never waits for the GPU. Copies as much of `src` as currently
+  // fits into the ring and returns the number of bytes consumed.
+  std::size_t tryUpload(vk::Buffer dst, vk::DeviceSize dst_offset, std::span<const std::byte> src);
+
+  // Submits the partially filled chunk, if any. Returns a ticket that
+  // completes once all uploads issued so far are done on the GPU.
+  std::uint64_t flush();
+
+  bool isDone(std::uint64_t ticket) const;
+  void wait(std::uint64_t ticket) const;
+  void waitIdle() const { wait(lastTicket); }
+
+  std::uint64_t getBytesUploaded() const { return bytesUploaded; }
+
+private:
+  std::size_t stream(
+    vk::Buffer dst, vk::DeviceSize dst_offset, std::span<const std::byte> src, bool may_wait);
+  bool acquireChunk(bool may_wait);
+  void submitChunk();
+
+private:
+  struct Chunk
+  {
+    vk::UniqueCommandBuffer cmdBuf;
+    vk::UniqueFence fence;
+    vk::DeviceSize used = 0;
+    bool recording = false;
+    // Ticket of the last submit of this chunk, 0 if it was never submitted
+    std::uint64_t ticket = 0;
+  };
+
+  vk::DeviceSize chunkSize;
+  etna::Buffer ring;
+  std::byte* ringData = nullptr;
+
+  vk::UniqueCommandPool commandPool;
+  std::vector<Chunk> chunks;
+  std::size_t current = 0;
+
+  std::uint64_t lastTicket = 0;
+  std::uint64_t bytesUploaded = 0;
+};
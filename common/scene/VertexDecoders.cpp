@@ -0,0 +1,391 @@
+#include "VertexDecoders.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <span>
+#include <utility>
+
+#include <fmt/format.h>
+#include <tiny_gltf.h>
+
+#include "NormalEncoding.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_DECODERS_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define VERTEX_DECODERS_USE_SSE 0
+#endif
+
+
+AttributeFormat attribute_format(int component_type, bool normalized)
+{
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return AttributeFormat::Float;
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    return normalized ? AttributeFormat::SNorm8 : AttributeFormat::SInt8;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return normalized ? AttributeFormat::UNorm8 : AttributeFormat::UInt8;
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+    return normalized ? AttributeFormat::SNorm16 : AttributeFormat::SInt16;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return normalized ? AttributeFormat::UNorm16 : AttributeFormat::UInt16;
+  default:
+    return AttributeFormat::Invalid;
+  }
+}
+
+const char* attribute_format_name(AttributeFormat format)
+{
+  switch (format)
+  {
+  case AttributeFormat::None:
+    return "none";
+  case AttributeFormat::Invalid:
+    return "invalid";
+  case AttributeFormat::Float:
+    return "f32";
+  case AttributeFormat::SInt8:
+    return "i8";
+  case AttributeFormat::UInt8:
+    return "u8";
+  case AttributeFormat::SInt16:
+    return "i16";
+  case AttributeFormat::UInt16:
+    return "u16";
+  case AttributeFormat::SNorm8:
+    return "snorm8";
+  case AttributeFormat::UNorm8:
+    return "unorm8";
+  case AttributeFormat::SNorm16:
+    return "snorm16";
+  case AttributeFormat::UNorm16:
+    return "unorm16";
+  }
+  return "unknown";
+}
+
+namespace
+{
+
+template <class T>
+T load(const std::byte* ptr)
+{
+  T result;
+  std::memcpy(&result, ptr, sizeof(T));
+  return result;
+}
+
+// Normalization rules are taken from the glTF spec, "Animations" section
+template <AttributeFormat Format>
+float read_component(const std::byte* ptr)
+{
+  if constexpr (Format == AttributeFormat::Float)
+    return load<float>(ptr);
+  else if constexpr (Format == AttributeFormat::SInt8)
+    return static_cast<float>(load<std::int8_t>(ptr));
+  else if constexpr (Format == AttributeFormat::UInt8)
+    return static_cast<float>(load<std::uint8_t>(ptr));
+  else if constexpr (Format == AttributeFormat::SInt16)
+    return static_cast<float>(load<std::int16_t>(ptr));
+  else if constexpr (Format == AttributeFormat::UInt16)
+    return static_cast<float>(load<std::uint16_t>(ptr));
+  else if constexpr (Format == AttributeFormat::SNorm8)
+    return glm::max(static_cast<float>(load<std::int8_t>(ptr)) / 127.0f, -1.0f);
+  else if constexpr (Format == AttributeFormat::UNorm8)
+    return static_cast<float>(load<std::uint8_t>(ptr)) / 255.0f;
+  else if constexpr (Format == AttributeFormat::SNorm16)
+    return glm::max(static_cast<float>(load<std::int16_t>(ptr)) / 32767.0f, -1.0f);
+  else if constexpr (Format == AttributeFormat::UNorm16)
+    return static_cast<float>(load<std::uint16_t>(ptr)) / 65535.0f;
+  else
+    return 0.0f;
+}
+
+template <AttributeFormat Format, glm::length_t N>
+glm::vec<N, float> read_vector(const std::byte* ptr)
+{
+  if constexpr (Format == AttributeFormat::None)
+    return glm::vec<N, float>{0};
+  else if constexpr (Format == AttributeFormat::Float)
+    return load<glm::vec<N, float>>(ptr);
+  else
+  {
+    glm::vec<N, float> result;
+    for (glm::length_t i = 0; i < N; ++i)
+      result[i] = read_component<Format>(ptr + i * component_size(Format));
+    return result;
+  }
+}
+
+template <AttributeFormat PositionFormat, AttributeFormat NormalFormat>
+void decode_position_normal(
+  AttributeStream position, AttributeStream normal, std::size_t count, glm::vec4* out)
+{
+  const std::byte* pos = position.data;
+  const std::byte* norm = normal.data;
+  for (std::size_t i = 0; i < count; ++i, out += 2)
+  {
+    *out = glm::vec4(
+      read_vector<PositionFormat, 3>(pos),
+      std::bit_cast<float>(encode_normal(read_vector<NormalFormat, 3>(norm))));
+
+    pos += position.stride;
+    if constexpr (NormalFormat != AttributeFormat::None)
+      norm += normal.stride;
+  }
+}
+
+template <AttributeFormat TexcoordFormat, AttributeFormat TangentFormat>
+void decode_texcoord_tangent(
+  AttributeStream texcoord, AttributeStream tangent, std::size_t count, glm::vec4* out)
+{
+  const std::byte* tex = texcoord.data;
+  const std::byte* tang = tangent.data;
+  for (std::size_t i = 0; i < count; ++i, out += 2)
+  {
+    *out = glm::vec4(
+      read_vector<TexcoordFormat, 2>(tex),
+      std::bit_cast<float>(encode_normal(read_vector<TangentFormat, 3>(tang))),
+      0);
+
+    if constexpr (TexcoordFormat != AttributeFormat::None)
+      tex += texcoord.stride;
+    if constexpr (TangentFormat != AttributeFormat::None)
+      tang += tangent.stride;
+  }
+}
+
+#if VERTEX_DECODERS_USE_SSE
+
+// Special versions for the most common case of tightly packed float attributes.
+// Normals are packed in blocks with the SIMD batch encoder first, then 4 vertices
+// at a time are loaded and shuffled into the output layout.
+
+constexpr std::size_t PACKED_BLOCK_SIZE = 64;
+
+void decode_position_normal_packed_f32(
+  AttributeStream position, AttributeStream normal, std::size_t count, glm::vec4* out)
+{
+  std::array<std::uint32_t, PACKED_BLOCK_SIZE> packedNormals;
+
+  const auto* pos = reinterpret_cast<const float*>(position.data);
+  for (std::size_t block = 0; block < count; block += PACKED_BLOCK_SIZE)
+  {
+    const std::size_t blockSize = std::min(PACKED_BLOCK_SIZE, count - block);
+    encode_normals(
+      normal.data + block * normal.stride,
+      normal.stride,
+      std::span{packedNormals}.first(blockSize));
+
+    std::size_t i = 0;
+    for (; i + 4 <= blockSize; i += 4, pos += 12, out += 8)
+    {
+      // [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3]
+      const __m128 p0 = _mm_loadu_ps(pos + 0);
+      const __m128 p1 = _mm_loadu_ps(pos + 4);
+      const __m128 p2 = _mm_loadu_ps(pos + 8);
+
+      const __m128 enc =
+        _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&packedNormals[i])));
+
+      // [z0 z0 e0 e0] -> [x0 y0 z0 e0]
+      const __m128 ze0 = _mm_shuffle_ps(p0, enc, _MM_SHUFFLE(0, 0, 2, 2));
+      const __m128 v0 = _mm_shuffle_ps(p0, ze0, _MM_SHUFFLE(2, 0, 1, 0));
+
+      // [x1 x1 y1 y1], [z1 z1 e1 e1] -> [x1 y1 z1 e1]
+      const __m128 xy1 = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(0, 0, 3, 3));
+      const __m128 ze1 = _mm_shuffle_ps(p1, enc, _MM_SHUFFLE(1, 1, 1, 1));
+      const __m128 v1 = _mm_shuffle_ps(xy1, ze1, _MM_SHUFFLE(2, 0, 2, 0));
+
+      // [z2 z2 e2 e2] -> [x2 y2 z2 e2]
+      const __m128 ze2 = _mm_shuffle_ps(p2, enc, _MM_SHUFFLE(2, 2, 0, 0));
+      const __m128 v2 = _mm_shuffle_ps(p1, ze2, _MM_SHUFFLE(2, 0, 3, 2));
+
+      // [z3 z3 e3 e3] -> [x3 y3 z3 e3]
+      const __m128 ze3 = _mm_shuffle_ps(p2, enc, _MM_SHUFFLE(3, 3, 3, 3));
+      const __m128 v3 = _mm_shuffle_ps(p2, ze3, _MM_SHUFFLE(2, 0, 2, 1));
+
+      _mm_storeu_ps(&out[0].x, v0);
+      _mm_storeu_ps(&out[2].x, v1);
+      _mm_storeu_ps(&out[4].x, v2);
+      _mm_storeu_ps(&out[6].x, v3);
+    }
+
+    for (; i < blockSize; ++i, pos += 3, out += 2)
+      *out = glm::vec4(
+        load<glm::vec3>(reinterpret_cast<const std::byte*>(pos)),
+        std::bit_cast<float>(packedNormals[i]));
+  }
+}
+
+void decode_texcoord_tangent_packed_f32(
+  AttributeStream texcoord, AttributeStream tangent, std::size_t count, glm::vec4* out)
+{
+  std::array<std::uint32_t, PACKED_BLOCK_SIZE> packedTangents;
+
+  const auto* tex = reinterpret_cast<const float*>(texcoord.data);
+  for (std::size_t block = 0; block < count; block += PACKED_BLOCK_SIZE)
+  {
+    const std::size_t blockSize = std::min(PACKED_BLOCK_SIZE, count - block);
+    encode_normals(
+      tangent.data + block * tangent.stride,
+      tangent.stride,
+      std::span{packedTangents}.first(blockSize));
+
+    std::size_t i = 0;
+    for (; i + 4 <= blockSize; i += 4, tex += 8, out += 8)
+    {
+      // [u0 v0 u1 v1] [u2 v2 u3 v3]
+      const __m128 t0 = _mm_loadu_ps(tex + 0);
+      const __m128 t1 = _mm_loadu_ps(tex + 4);
+
+      const __m128 enc =
+        _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&packedTangents[i])));
+
+      // [e0 0 e1 0] [e2 0 e3 0]
+      const __m128 lo = _mm_unpacklo_ps(enc, _mm_setzero_ps());
+      const __m128 hi = _mm_unpackhi_ps(enc, _mm_setzero_ps());
+
+      _mm_storeu_ps(&out[0].x, _mm_movelh_ps(t0, lo));
+      _mm_storeu_ps(&out[2].x, _mm_shuffle_ps(t0, lo, _MM_SHUFFLE(3, 2, 3, 2)));
+      _mm_storeu_ps(&out[4].x, _mm_movelh_ps(t1, hi));
+      _mm_storeu_ps(&out[6].x, _mm_shuffle_ps(t1, hi, _MM_SHUFFLE(3, 2, 3, 2)));
+    }
+
+    for (; i < blockSize; ++i, tex += 2, out += 2)
+      *out = glm::vec4(
+        load<glm::vec2>(reinterpret_cast<const std::byte*>(tex)),
+        std::bit_cast<float>(packedTangents[i]),
+        0);
+  }
+}
+
+#endif
+
+// Formats allowed by the KHR_mesh_quantization spec for each attribute
+constexpr std::array POSITION_FORMATS{
+  AttributeFormat::Float,
+  AttributeFormat::SInt8,
+  AttributeFormat::UInt8,
+  AttributeFormat::SInt16,
+  AttributeFormat::UInt16,
+  AttributeFormat::SNorm8,
+  AttributeFormat::UNorm8,
+  AttributeFormat::SNorm16,
+  AttributeFormat::UNorm16,
+};
+
+constexpr std::array NORMAL_FORMATS{
+  AttributeFormat::None,
+  AttributeFormat::Float,
+  AttributeFormat::SNorm8,
+  AttributeFormat::SNorm16,
+};
+
+constexpr std::array TEXCOORD_FORMATS{
+  AttributeFormat::None,
+  AttributeFormat::Float,
+  AttributeFormat::SInt8,
+  AttributeFormat::UInt8,
+  AttributeFormat::SInt16,
+  AttributeFormat::UInt16,
+  AttributeFormat::SNorm8,
+  AttributeFormat::UNorm8,
+  AttributeFormat::SNorm16,
+  AttributeFormat::UNorm16,
+};
+
+// Tangents are allowed the same formats as normals
+constexpr const auto& TANGENT_FORMATS = NORMAL_FORMATS;
+
+template <std::size_t N>
+constexpr std::size_t index_of(
+  const std::array<AttributeFormat, N>& formats, AttributeFormat format)
+{
+  for (std::size_t i = 0; i < N; ++i)
+    if (formats[i] == format)
+      return i;
+  return N;
+}
+
+template <std::size_t... I>
+constexpr auto make_position_normal_table(std::index_sequence<I...>)
+{
+  constexpr std::size_t INNER = NORMAL_FORMATS.size();
+  return std::array<VertexDecoder, sizeof...(I)>{
+    &decode_position_normal<POSITION_FORMATS[I / INNER], NORMAL_FORMATS[I % INNER]>...};
+}
+
+template <std::size_t... I>
+constexpr auto make_texcoord_tangent_table(std::index_sequence<I...>)
+{
+  constexpr std::size_t INNER = TANGENT_FORMATS.size();
+  return std::array<VertexDecoder, sizeof...(I)>{
+    &decode_texcoord_tangent<TEXCOORD_FORMATS[I / INNER], TANGENT_FORMATS[I % INNER]>...};
+}
+
+constexpr auto POSITION_NORMAL_DECODERS = make_position_normal_table(
+  std::make_index_sequence<POSITION_FORMATS.size() * NORMAL_FORMATS.size()>{});
+
+constexpr auto TEXCOORD_TANGENT_DECODERS = make_texcoord_tangent_table(
+  std::make_index_sequence<TEXCOORD_FORMATS.size() * TANGENT_FORMATS.size()>{});
+
+} // namespace
+
+VertexDecoder get_position_normal_decoder(AttributeStream position, AttributeStream normal)
+{
+  const std::size_t posIdx = index_of(POSITION_FORMATS, position.format);
+  const std::size_t normIdx = index_of(NORMAL_FORMATS, normal.format);
+  if (posIdx == POSITION_FORMATS.size() || normIdx == NORMAL_FORMATS.size())
+    return nullptr;
+
+#if VERTEX_DECODERS_USE_SSE
+  if (
+    position.format == AttributeFormat::Float && normal.format == AttributeFormat::Float &&
+    position.stride == sizeof(glm::vec3) && normal.stride == sizeof(glm::vec3))
+    return &decode_position_normal_packed_f32;
+#endif
+
+  return POSITION_NORMAL_DECODERS[posIdx * NORMAL_FORMATS.size() + normIdx];
+}
+
+VertexDecoder get_texcoord_tangent_decoder(AttributeStream texcoord, AttributeStream tangent)
+{
+  const std::size_t texIdx = index_of(TEXCOORD_FORMATS, texcoord.format);
+  const std::size_t tangIdx = index_of(TANGENT_FORMATS, tangent.format);
+  if (texIdx == TEXCOORD_FORMATS.size() || tangIdx == TANGENT_FORMATS.size())
+    return nullptr;
+
+#if VERTEX_DECODERS_USE_SSE
+  // NOTE: glTF tangents are vec4s, so the tangent stream can't be
+  // tightly packed as vec3s, we only care about texcoords here.
+  if (
+    texcoord.format == AttributeFormat::Float && tangent.format == AttributeFormat::Float &&
+    texcoord.stride == sizeof(glm::vec2))
+    return &decode_texcoord_tangent_packed_f32;
+#endif
+
+  return TEXCOORD_TANGENT_DECODERS[texIdx * TANGENT_FORMATS.size() + tangIdx];
+}
+
+std::string vertex_decoder_name(
+  VertexDecoder decoder, AttributeStream first, AttributeStream second)
+{
+#if VERTEX_DECODERS_USE_SSE
+  const bool simd = decoder == &decode_position_normal_packed_f32 ||
+    decoder == &decode_texcoord_tangent_packed_f32;
+#else
+  (void)decoder;
+  const bool simd = false;
+#endif
+  return fmt::format(
+    "{}/{}{}",
+    attribute_format_name(first.format),
+    attribute_format_name(second.format),
+    simd ? " (sse)" : "");
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+
+
+// Component formats that glTF allows for vertex attributes, including
+// the ones added by the KHR_mesh_quantization extension.
+enum class AttributeFormat : std::uint8_t
+{
+  None, // The attribute is absent and is decoded as zeroes
+  Invalid, // A component type glTF doesn't allow for vertex data, there is no decoder for it
+  Float,
+  SInt8,
+  UInt8,
+  SInt16,
+  UInt16,
+  SNorm8,
+  UNorm8,
+  SNorm16,
+  UNorm16,
+};
+
+// Maps a glTF component type + `normalized` flag to our format.
+// Returns AttributeFormat::Invalid for things glTF doesn't allow for vertex data.
+AttributeFormat attribute_format(int component_type, bool normalized);
+
+const char* attribute_format_name(AttributeFormat format);
+
+constexpr std::size_t component_size(AttributeFormat format)
+{
+  switch (format)
+  {
+  case AttributeFormat::Float:
+    return 4;
+  case AttributeFormat::SInt16:
+  case AttributeFormat::UInt16:
+  case AttributeFormat::SNorm16:
+  case AttributeFormat::UNorm16:
+    return 2;
+  case AttributeFormat::SInt8:
+  case AttributeFormat::UInt8:
+  case AttributeFormat::SNorm8:
+  case AttributeFormat::UNorm8:
+    return 1;
+  case AttributeFormat::None:
+  case AttributeFormat::Invalid:
+    return 0;
+  }
+  return 0;
+}
+
+struct AttributeStream
+{
+  const std::byte* data = nullptr;
+  std::size_t stride = 0;
+  AttributeFormat format = AttributeFormat::None;
+};
+
+/**
+ * A vertex is packed into 2 vec4s (see SceneManager::Vertex), each one of which
+ * is filled by a separate decoder:
+ *  - (position.xyz, packed normal)
+ *  - (texcoord.xy, packed tangent, 0)
+ * Decoders write `count` vertices starting at `out`, consecutive vertices are 2 vec4s apart.
+ * Every decoder is a template instance specialized for a specific pair of attribute formats,
+ * so there are no per-vertex branches, only a single lookup per primitive.
+ */
+using VertexDecoder = void (*)(AttributeStream, AttributeStream, std::size_t count, glm::vec4* out);
+
+// Both return nullptr if the format combination is not supported by glTF,
+// which includes any of the streams being AttributeFormat::Invalid
+VertexDecoder get_position_normal_decoder(AttributeStream position, AttributeStream normal);
+VertexDecoder get_texcoord_tangent_decoder(AttributeStream texcoord, AttributeStream tangent);
+
+// Human-readable name of a decoder returned by one of the functions above
+std::string vertex_decoder_name(
+  VertexDecoder decoder, AttributeStream first, AttributeStream second);
@@ -0,0 +1,202 @@
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "VertexDecoders.hpp"
+#include "NormalEncoding.hpp"
+
+
+// Microbenchmark for the vertex decoders used by SceneManager.
+// Decodes a synthetic buffer with every supported format combination
+// and reports the throughput of every specialization.
+// Also checks that the batch normal encoder matches the scalar one.
+
+namespace
+{
+
+constexpr std::size_t VERTEX_COUNT = 1 << 20;
+constexpr int REPETITIONS = 8;
+
+constexpr std::array ALL_FORMATS{
+  AttributeFormat::None,
+  AttributeFormat::Float,
+  AttributeFormat::SInt8,
+  AttributeFormat::UInt8,
+  AttributeFormat::SInt16,
+  AttributeFormat::UInt16,
+  AttributeFormat::SNorm8,
+  AttributeFormat::UNorm8,
+  AttributeFormat::SNorm16,
+  AttributeFormat::UNorm16,
+};
+
+struct Stream
+{
+  std::vector<std::byte> storage;
+  AttributeStream stream;
+};
+
+// `interleaved_stride` of 0 means tightly packed
+Stream make_stream(AttributeFormat format, std::size_t components, std::size_t interleaved_stride)
+{
+  Stream result;
+  if (format == AttributeFormat::None)
+    return result;
+
+  const std::size_t stride =
+    interleaved_stride != 0 ? interleaved_stride : components * component_size(format);
+  result.storage.resize(stride * VERTEX_COUNT);
+
+  // Some plausible unit-length-ish data, the exact values don't matter for throughput
+  for (std::size_t i = 0; i < VERTEX_COUNT; ++i)
+    for (std::size_t c = 0; c < components; ++c)
+    {
+      const float value = c == 0 ? 0.6f : (c == 1 ? -0.48f : 0.64f);
+      std::byte* dst = result.storage.data() + i * stride + c * component_size(format);
+      if (format == AttributeFormat::Float)
+        std::memcpy(dst, &value, sizeof(value));
+      else if (component_size(format) == 2)
+      {
+        const auto v = static_cast<std::int16_t>(value * 32767.0f);
+        std::memcpy(dst, &v, sizeof(v));
+      }
+      else
+        *dst = static_cast<std::byte>(static_cast<std::int8_t>(value * 127.0f));
+    }
+
+  result.stream = AttributeStream{
+    .data = result.storage.data(),
+    .stride = stride,
+    .format = format,
+  };
+  return result;
+}
+
+void run(
+  const char* kind,
+  VertexDecoder decoder,
+  const AttributeStream& first,
+  const AttributeStream& second,
+  std::vector<glm::vec4>& output)
+{
+  if (decoder == nullptr)
+    return;
+
+  using Clock = std::chrono::steady_clock;
+
+  // Warm up caches and page in the output
+  decoder(first, second, VERTEX_COUNT, output.data());
+
+  const auto start = Clock::now();
+  for (int i = 0; i < REPETITIONS; ++i)
+    decoder(first, second, VERTEX_COUNT, output.data());
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  const double verticesPerSecond = VERTEX_COUNT * REPETITIONS / elapsed.count();
+  spdlog::info(
+    "{:>16} {:<24} {:8.1f} Mvert/s",
+    kind,
+    vertex_decoder_name(decoder, first, second),
+    verticesPerSecond / 1e6);
+}
+
+void bench_normal_encoding()
+{
+  using Clock = std::chrono::steady_clock;
+
+  std::mt19937 rng{42};
+  std::normal_distribution<float> dist;
+  std::vector<glm::vec3> normals(VERTEX_COUNT);
+  for (auto& n : normals)
+    n = glm::normalize(glm::vec3{dist(rng), dist(rng), dist(rng)});
+
+  std::vector<std::uint32_t> scalar(VERTEX_COUNT);
+  std::vector<std::uint32_t> batch(VERTEX_COUNT);
+
+  const auto scalarStart = Clock::now();
+  for (int r = 0; r < REPETITIONS; ++r)
+    for (std::size_t i = 0; i < VERTEX_COUNT; ++i)
+      scalar[i] = encode_normal(normals[i]);
+  const std::chrono::duration<double> scalarTime = Clock::now() - scalarStart;
+
+  const auto batchStart = Clock::now();
+  for (int r = 0; r < REPETITIONS; ++r)
+    encode_normals(normals, batch);
+  const std::chrono::duration<double> batchTime = Clock::now() - batchStart;
+
+  std::size_t mismatches = 0;
+  float maxError = 0;
+  for (std::size_t i = 0; i < VERTEX_COUNT; ++i)
+  {
+    if (scalar[i] != batch[i])
+      ++mismatches;
+    maxError = std::max(maxError, glm::length(decode_normal(batch[i]) - normals[i]));
+  }
+
+  spdlog::info(
+    "{:>16} {:<24} {:8.1f} Mvert/s",
+    "normals",
+    "scalar",
+    VERTEX_COUNT * REPETITIONS / scalarTime.count() / 1e6);
+  spdlog::info(
+    "{:>16} {:<24} {:8.1f} Mvert/s",
+    "normals",
+    "batch",
+    VERTEX_COUNT * REPETITIONS / batchTime.count() / 1e6);
+  spdlog::info(
+    "Batch vs scalar mismatches: {}, max round-trip error: {}", mismatches, maxError);
+}
+
+} // namespace
+
+int main()
+{
+  bench_normal_encoding();
+
+  std::vector<glm::vec4> output(2 * VERTEX_COUNT);
+
+  for (auto posFormat : ALL_FORMATS)
+    for (auto normFormat : ALL_FORMATS)
+    {
+      auto position = make_stream(posFormat, 3, 0);
+      auto normal = make_stream(normFormat, 3, 0);
+      run(
+        "position/normal",
+        get_position_normal_decoder(position.stream, normal.stream),
+        position.stream,
+        normal.stream,
+        output);
+    }
+
+  for (auto texFormat : ALL_FORMATS)
+    for (auto tangFormat : ALL_FORMATS)
+    {
+      auto texcoord = make_stream(texFormat, 2, 0);
+      auto tangent = make_stream(tangFormat, 4, 0);
+      run(
+        "texcoord/tangent",
+        get_texcoord_tangent_decoder(texcoord.stream, tangent.stream),
+        texcoord.stream,
+        tangent.stream,
+        output);
+    }
+
+  // Interleaved float data does not hit the SIMD path, which is useful for comparison
+  {
+    auto position = make_stream(AttributeFormat::Float, 3, 32);
+    auto normal = make_stream(AttributeFormat::Float, 3, 32);
+    run(
+      "interleaved",
+      get_position_normal_decoder(position.stream, normal.stream),
+      position.stream,
+      normal.stream,
+      output);
+  }
+
+  return 0;
+}
@@ -1,11 +1,16 @@
 #include "App.hpp"
 
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
 #include <tracy/Tracy.hpp>
 
 #include "gui/ImGuiRenderer.hpp"
 
+#include "FramePacketStream.hpp"
+
 
-App::App()
+App::App(std::uint32_t frames_in_flight)
 {
   glm::uvec2 initialRes = {1280, 720};
   mainWindow = windowing.createWindow(OsWindow::CreateInfo{
@@ -26,7 +31,7 @@ App::App()
       },
   });
 
-  renderer.reset(new Renderer(initialRes));
+  renderer.reset(new Renderer(initialRes, frames_in_flight));
 
   auto instExts = windowing.getRequiredVulkanInstanceExtensions();
   renderer->initVulkan(instExts);
@@ -43,7 +48,11 @@ App::App()
   shadowCam.lookAt({-8, 10, 8}, {0, 0, 0}, {0, 1, 0});
   mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
 
-  renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+  // The baked version of the scene has LODs, it's there once model_bakery_baker is run on it
+  const std::filesystem::path sceneDir =
+    GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town";
+  const bool baked = std::filesystem::exists(sceneDir / "scene_baked.gltf");
+  renderer->loadScene(sceneDir / (baked ? "scene_baked.gltf" : "scene.gltf"));
 }
 
 void App::run()
@@ -80,6 +89,18 @@ void App::processInput(float dt)
   if (mainWindow->keyboard[KeyboardKey::kL] == ButtonState::Falling)
     controlShadowCam = !controlShadowCam;
 
+  if (mainWindow->keyboard[KeyboardKey::kF5] == ButtonState::Falling)
+  {
+    recordingPackets = !recordingPackets;
+    if (recordingPackets)
+    {
+      recordedPackets.clear();
+      spdlog::info("Recording the camera path, press F5 again to stop");
+    }
+    else if (write_frame_packets("camera_path.fpk", recordedPackets))
+      spdlog::info("Camera path of {} frames written to camera_path.fpk", recordedPackets.size());
+  }
+
   if (mainWindow->mouse[MouseButton::mbRight] == ButtonState::Rising)
     mainWindow->captureMouse = !mainWindow->captureMouse;
 
@@ -96,11 +117,16 @@ void App::drawFrame()
 {
   ZoneScoped;
 
-  renderer->update(FramePacket{
+  const FramePacket packet{
     .mainCam = mainCam,
     .shadowCam = shadowCam,
     .currentTime = static_cast<float>(windowing.getTime()),
-  });
+  };
+
+  if (recordingPackets)
+    recordedPackets.push_back(packet);
+
+  renderer->update(packet);
   renderer->drawFrame();
 }
 
@@ -13,7 +13,7 @@
 class App
 {
 public:
-  App();
+  explicit App(std::uint32_t frames_in_flight);
 
   void run();
 
@@ -36,5 +36,9 @@ private:
 
   bool controlShadowCam = false;
 
+  // Packets of every frame while recording a camera path for benchmarks, see FramePacketStream
+  bool recordingPackets = false;
+  std::vector<FramePacket> recordedPackets;
+
   std::unique_ptr<Renderer> renderer;
 };
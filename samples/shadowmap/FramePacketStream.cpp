@@ -0,0 +1,167 @@
+#include "FramePacketStream.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+
+constexpr std::uint32_t FRAME_PACKET_MAGIC = 0x4b504646; // "FFPK"
+constexpr std::uint32_t FRAME_PACKET_VERSION = 1;
+
+struct FileHeader
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t packetCount;
+};
+
+// Only the parts of a camera that affect rendering, packed tightly
+using PackedCamera = std::array<float, 10>;
+
+struct PackedPacket
+{
+  PackedCamera mainCam;
+  PackedCamera shadowCam;
+  float currentTime;
+};
+
+static_assert(sizeof(PackedPacket) == 84);
+
+PackedCamera pack_camera(const Camera& cam)
+{
+  return {
+    cam.position.x,
+    cam.position.y,
+    cam.position.z,
+    cam.rotation.x,
+    cam.rotation.y,
+    cam.rotation.z,
+    cam.rotation.w,
+    cam.fov,
+    cam.zNear,
+    cam.zFar,
+  };
+}
+
+Camera unpack_camera(const PackedCamera& packed)
+{
+  Camera cam;
+  cam.position = {packed[0], packed[1], packed[2]};
+  cam.rotation = glm::quat(packed[6], packed[3], packed[4], packed[5]);
+  cam.fov = packed[7];
+  cam.zNear = packed[8];
+  cam.zFar = packed[9];
+  return cam;
+}
+
+Camera mix_cameras(const Camera& a, const Camera& b, float t)
+{
+  Camera cam = a;
+  cam.position = glm::mix(a.position, b.position, t);
+  cam.rotation = glm::slerp(a.rotation, b.rotation, t);
+  cam.fov = glm::mix(a.fov, b.fov, t);
+  return cam;
+}
+
+} // namespace
+
+bool write_frame_packets(const std::filesystem::path& path, std::span<const FramePacket> packets)
+{
+  std::ofstream file{path, std::ios::binary};
+  if (!file)
+  {
+    spdlog::error("Unable to open {} for writing", path.string());
+    return false;
+  }
+
+  const FileHeader header{
+    .magic = FRAME_PACKET_MAGIC,
+    .version = FRAME_PACKET_VERSION,
+    .packetCount = static_cast<std::uint32_t>(packets.size()),
+  };
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  for (const auto& packet : packets)
+  {
+    const PackedPacket packed{
+      .mainCam = pack_camera(packet.mainCam),
+      .shadowCam = pack_camera(packet.shadowCam),
+      .currentTime = packet.currentTime,
+    };
+    file.write(reinterpret_cast<const char*>(&packed), sizeof(packed));
+  }
+
+  if (!file)
+  {
+    spdlog::error("Failed to write frame packets to {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+std::vector<FramePacket> read_frame_packets(const std::filesystem::path& path)
+{
+  std::ifstream file{path, std::ios::binary};
+  if (!file)
+  {
+    spdlog::error("Unable to open {}", path.string());
+    return {};
+  }
+
+  FileHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || header.magic != FRAME_PACKET_MAGIC || header.version != FRAME_PACKET_VERSION)
+  {
+    spdlog::error(
+      "{} is not a frame packet recording of version {}", path.string(), FRAME_PACKET_VERSION);
+    return {};
+  }
+
+  std::vector<PackedPacket> packed(header.packetCount);
+  file.read(reinterpret_cast<char*>(packed.data()), packed.size() * sizeof(PackedPacket));
+  if (!file)
+  {
+    spdlog::error("{} is truncated", path.string());
+    return {};
+  }
+
+  std::vector<FramePacket> packets;
+  packets.reserve(packed.size());
+  for (const auto& p : packed)
+    packets.push_back(FramePacket{
+      .mainCam = unpack_camera(p.mainCam),
+      .shadowCam = unpack_camera(p.shadowCam),
+      .currentTime = p.currentTime,
+    });
+
+  return packets;
+}
+
+FramePacket sample_frame_packets(std::span<const FramePacket> packets, float time)
+{
+  auto next = std::lower_bound(
+    packets.begin(), packets.end(), time, [](const FramePacket& packet, float t) {
+      return packet.currentTime < t;
+    });
+
+  if (next == packets.begin())
+    return packets.front();
+  if (next == packets.end())
+    return packets.back();
+
+  const auto& prev = *(next - 1);
+  const float span = next->currentTime - prev.currentTime;
+  const float t = span > 0 ? (time - prev.currentTime) / span : 1.0f;
+
+  return FramePacket{
+    .mainCam = mix_cameras(prev.mainCam, next->mainCam, t),
+    .shadowCam = mix_cameras(prev.shadowCam, next->shadowCam, t),
+    .currentTime = time,
+  };
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "FramePacket.hpp"
+
+
+// Recordings of FramePacket streams for replaying camera paths in benchmarks. The file is
+// a small header followed by the raw cameras and times of every packet, 84 bytes each.
+// Returns false and logs the reason on failure.
+bool write_frame_packets(const std::filesystem::path& path, std::span<const FramePacket> packets);
+
+// Returns an empty vector and logs the reason on failure
+std::vector<FramePacket> read_frame_packets(const std::filesystem::path& path);
+
+// Interpolates recorded packets at `time`, so that a recording made at an arbitrary
+// frame rate can be replayed at a fixed timestep. Times outside of the recording are
+// clamped to it. `packets` must be non-empty and sorted by time.
+FramePacket sample_frame_packets(std::span<const FramePacket> packets, float time);
@@ -0,0 +1,134 @@
+#include "HeadlessApp.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <numbers>
+
+#include <spdlog/spdlog.h>
+#include <tracy/Tracy.hpp>
+
+#include "FramePacketStream.hpp"
+
+
+// Every frame advances the time by exactly this much, so runs render the same frames
+static constexpr float FRAME_TIMESTEP = 1.0f / 60.0f;
+
+bool write_frame_timings(const std::filesystem::path& path, std::span<const FrameTiming> timings)
+{
+  std::ofstream csv{path};
+  if (!csv)
+  {
+    spdlog::error("Unable to open {} for writing", path.string());
+    return false;
+  }
+
+  csv << "frame,cpu_ms,gpu_ms,draw_calls,triangles\n";
+  for (std::size_t i = 0; i < timings.size(); ++i)
+    csv << i << ',' << timings[i].cpuMs << ',' << timings[i].gpuMs << ','
+        << timings[i].drawCalls << ',' << timings[i].triangles << '\n';
+
+  return true;
+}
+
+HeadlessApp::HeadlessApp(CreateInfo info)
+{
+  renderer.reset(new Renderer(info.resolution, info.framesInFlight));
+
+  renderer->initVulkan({});
+  renderer->initHeadless();
+  renderer->setGpuCulling(info.gpuCulling);
+
+  shadowCam.lookAt({-8, 10, 8}, {0, 0, 0}, {0, 1, 0});
+}
+
+std::vector<FrameTiming> HeadlessApp::run(const RunInfo& info)
+{
+  const float startTime = info.cameraPath.empty() ? 0 : info.cameraPath.front().currentTime;
+  const std::uint32_t frameCount = info.frameCount > 0 || info.cameraPath.empty()
+    ? info.frameCount
+    : static_cast<std::uint32_t>(
+        (info.cameraPath.back().currentTime - startTime) / FRAME_TIMESTEP + 1);
+  const float duration = static_cast<float>(frameCount) * FRAME_TIMESTEP;
+
+  auto packetAt = [&](std::uint32_t frame) {
+    const float time = startTime + static_cast<float>(frame) * FRAME_TIMESTEP;
+    return info.cameraPath.empty() ? orbitPacket(time, duration)
+                                   : sample_frame_packets(info.cameraPath, time);
+  };
+
+  renderer->loadScene(info.scenePath);
+
+  // Scene loading is asynchronous, frames drawn before it is done would measure nothing
+  std::uint32_t warmUpFrames = 0;
+  while (renderer->isLoadingScene())
+  {
+    drawFrame(packetAt(0));
+    FrameMark;
+    ++warmUpFrames;
+  }
+  renderer->waitIdle();
+  renderer->takeGpuFrameTimes();
+  const std::uint64_t firstFrame = framesDrawn;
+
+  spdlog::info(
+    "{} loaded after {} frames, rendering {} frames",
+    info.scenePath.string(),
+    warmUpFrames,
+    frameCount);
+
+  std::vector<FrameTiming> timings;
+  timings.reserve(frameCount);
+  for (std::uint32_t i = 0; i < frameCount; ++i)
+  {
+    const auto packet = packetAt(i);
+
+    const auto start = std::chrono::steady_clock::now();
+    drawFrame(packet);
+    const double cpuMs =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    FrameMark;
+
+    const auto stats = renderer->getFrameStats();
+    timings.push_back(FrameTiming{
+      .cpuMs = cpuMs,
+      .gpuMs = -1,
+      .drawCalls = stats.drawCalls,
+      .triangles = stats.triangles,
+    });
+  }
+
+  // The last frames only get their GPU times once the GPU is done with them
+  renderer->waitIdle();
+  for (const auto& time : renderer->takeGpuFrameTimes())
+    if (time.frame >= firstFrame && time.frame - firstFrame < frameCount)
+      timings[time.frame - firstFrame].gpuMs = time.milliseconds;
+
+  return timings;
+}
+
+FramePacket HeadlessApp::orbitPacket(float time, float duration) const
+{
+  // Two full orbits around the origin over the whole run, bobbing up and down a bit
+  const float angle = 4.0f * std::numbers::pi_v<float> * time / duration;
+
+  FramePacket packet{
+    .mainCam = {},
+    .shadowCam = shadowCam,
+    .currentTime = time,
+  };
+  packet.mainCam.lookAt(
+    {15.0f * std::cos(angle), 8.0f + 3.0f * std::sin(angle), 15.0f * std::sin(angle)},
+    {0, 0, 0},
+    {0, 1, 0});
+  return packet;
+}
+
+void HeadlessApp::drawFrame(const FramePacket& packet)
+{
+  ZoneScoped;
+
+  renderer->update(packet);
+  renderer->drawFrame();
+  ++framesDrawn;
+}
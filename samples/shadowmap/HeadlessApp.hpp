@@ -0,0 +1,62 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "scene/Camera.hpp"
+
+#include "Renderer.hpp"
+
+
+struct FrameTiming
+{
+  double cpuMs;
+  // Negative if the GPU time of the frame is unknown
+  double gpuMs;
+  std::uint32_t drawCalls;
+  std::uint64_t triangles;
+};
+
+// Writes one line per frame, returns false and logs the reason on failure
+bool write_frame_timings(const std::filesystem::path& path, std::span<const FrameTiming> timings);
+
+/**
+ * Renders frames offscreen along a camera path and measures their CPU and GPU times.
+ * Needs no window, so it can run in CI on machines with only a software Vulkan
+ * implementation. Several scenes can be benchmarked one after another.
+ */
+class HeadlessApp
+{
+public:
+  struct CreateInfo
+  {
+    std::uint32_t framesInFlight = 2;
+    glm::uvec2 resolution = {1280, 720};
+    bool gpuCulling = true;
+  };
+
+  explicit HeadlessApp(CreateInfo info);
+
+  struct RunInfo
+  {
+    std::filesystem::path scenePath;
+    // Replayed at 60 FPS if not empty, an orbit around the origin is flown otherwise
+    std::span<const FramePacket> cameraPath;
+    // Zero means the whole camera path, must be set for the orbit
+    std::uint32_t frameCount = 0;
+  };
+
+  std::vector<FrameTiming> run(const RunInfo& info);
+
+private:
+  FramePacket orbitPacket(float time, float duration) const;
+  void drawFrame(const FramePacket& packet);
+
+private:
+  Camera shadowCam;
+  // Matches the frame indices of GpuFrameTime, as every frame is timed
+  std::uint64_t framesDrawn = 0;
+
+  std::unique_ptr<Renderer> renderer;
+};
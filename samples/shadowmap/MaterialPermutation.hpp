@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+/**
+ * Features of the main pass fragment shader that are chosen at compile time. CMake
+ * builds simple_shadow.frag once for every combination of them, so disabled features
+ * cost nothing on the GPU. Pipelines are only built for the combinations that get
+ * selected, the first time they are, and are kept for switching back.
+ */
+struct MaterialPermutation
+{
+  // Filter shadows with 3x3 PCF instead of a single tap
+  bool pcf = false;
+  bool animatedLight = true;
+  // Tint everything by the shadow cascade it falls into
+  bool showCascades = false;
+
+  static constexpr std::uint32_t COUNT = 1u << 3;
+
+  // Matches the VARIANT suffixes of the shader binaries in CMakeLists.txt
+  std::uint32_t index() const
+  {
+    return std::uint32_t{pcf} | std::uint32_t{animatedLight} << 1
+      | std::uint32_t{showCascades} << 2;
+  }
+
+  static MaterialPermutation fromIndex(std::uint32_t index)
+  {
+    return {
+      .pcf = (index & 1u) != 0,
+      .animatedLight = (index & 2u) != 0,
+      .showCascades = (index & 4u) != 0,
+    };
+  }
+
+  std::string programName() const { return "simple_material_p" + std::to_string(index()); }
+};
@@ -1,17 +1,21 @@
 #include "Renderer.hpp"
 
+#include <array>
+#include <chrono>
+#include <cstdlib>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
 #include <etna/RenderTargetStates.hpp>
-#include <etna/PipelineManager.hpp>
 #include <etna/Profiling.hpp>
 #include <imgui.h>
 
 #include <gui/ImGuiRenderer.hpp>
 
 
-Renderer::Renderer(glm::uvec2 res)
+Renderer::Renderer(glm::uvec2 res, std::uint32_t frames_in_flight)
   : resolution{res}
+  , framesInFlight{frames_in_flight}
 {
 }
 
@@ -26,16 +30,23 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+  // GPU culling writes the draw count and passes instance indices through firstInstance
+  vk::PhysicalDeviceVulkan12Features vulkan12Features{.drawIndirectCount = vk::True};
+
   etna::initialize(etna::InitParams{
     .applicationName = "ShadowmapSample",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    .features =
+      vk::PhysicalDeviceFeatures2{
+        .pNext = &vulkan12Features,
+        .features = {.drawIndirectFirstInstance = vk::True},
+      },
     // Replace with an index if etna detects your preferred GPU incorrectly
     .physicalDeviceIndexOverride = {},
     // How much frames we buffer on the GPU without waiting for their completion on the CPU
-    .numFramesInFlight = 2,
+    .numFramesInFlight = framesInFlight,
   });
 }
 
@@ -45,43 +56,77 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   resolutionProvider = std::move(res_provider);
   commandManager = ctx.createPerFrameCmdMgr();
+  gpuFrameTimer = std::make_unique<GpuFrameTimer>(framesInFlight);
 
-  window = ctx.createWindow(etna::Window::CreateInfo{
-    .surface = std::move(a_surface),
-  });
+  swapchain = std::make_unique<Swapchain>(std::move(a_surface));
 
-  auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
-    .resolution = {resolution.x, resolution.y},
+  auto [w, h] = swapchain->recreate(Swapchain::DesiredProperties{
+    .resolution = resolution,
     .vsync = true,
   });
   resolution = {w, h};
 
-  worldRenderer = std::make_unique<WorldRenderer>();
+  // Shared by every pipeline of the sample: the builder's and the one of ImGui
+  pipelineCache = std::make_unique<PersistentPipelineCache>("shadowmap_pipeline_cache.bin");
+  pipelineBuilder = std::make_unique<PipelineBuilder>(pipelineCache->get());
+
+  worldRenderer = std::make_unique<WorldRenderer>(*pipelineBuilder);
+
+  std::filesystem::path shadersRoot = SHADOWMAP_SHADERS_ROOT;
+#ifdef SHADER_HOT_RELOAD
+  const std::array shaderDirs{shadersRoot};
+  shaderReloader = std::make_unique<ShaderHotReloader>(shaderDirs);
+  shadersRoot = shaderReloader->getLoadDirectory(shadersRoot);
+#endif
 
   worldRenderer->allocateResources(resolution);
-  worldRenderer->loadShaders();
-  worldRenderer->setupPipelines(window->getCurrentFormat());
+  worldRenderer->loadShaders(shadersRoot);
+  // Only registers the pipelines, they are built in the background while ImGui sets up
+  worldRenderer->setupPipelines(swapchain->getCurrentFormat());
 
-  guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
+  guiRenderer =
+    std::make_unique<ImGuiRenderer>(swapchain->getCurrentFormat(), pipelineCache->get());
 }
 
-void Renderer::recreateSwapchain(glm::uvec2 res)
+void Renderer::initHeadless()
 {
   auto& ctx = etna::get_context();
 
-  ETNA_CHECK_VK_RESULT(ctx.getDevice().waitIdle());
+  commandManager = ctx.createPerFrameCmdMgr();
+  gpuFrameTimer = std::make_unique<GpuFrameTimer>(framesInFlight);
+
+  headlessPresenter = std::make_unique<HeadlessPresenter>(HeadlessPresenter::CreateInfo{
+    .resolution = resolution,
+    .imageCount = framesInFlight,
+  });
+
+  // Benchmarks start as fast as interactive runs, so they share the cache
+  pipelineCache = std::make_unique<PersistentPipelineCache>("shadowmap_pipeline_cache.bin");
+  pipelineBuilder = std::make_unique<PipelineBuilder>(pipelineCache->get());
+
+  worldRenderer = std::make_unique<WorldRenderer>(*pipelineBuilder);
 
-  auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
-    .resolution = {res.x, res.y},
+  worldRenderer->allocateResources(resolution);
+  worldRenderer->loadShaders(SHADOWMAP_SHADERS_ROOT);
+  worldRenderer->setupPipelines(headlessPresenter->getFormat());
+}
+
+void Renderer::recreateSwapchain(glm::uvec2 res)
+{
+  // NOTE: nothing waits for the device here. The old swapchain and the targets of the
+  // old size are retired, the frames in flight finish with them while the next ones
+  // already render at the new size.
+  auto [w, h] = swapchain->recreate(Swapchain::DesiredProperties{
+    .resolution = res,
     .vsync = true,
   });
   resolution = {w, h};
 
-  // Most resources depend on the current resolution, so we recreate them.
-  worldRenderer->allocateResources(resolution);
+  worldRenderer->resize(resolution);
 
   // Format of the swapchain CAN change on android
-  worldRenderer->setupPipelines(window->getCurrentFormat());
+  if (swapchain->getCurrentFormat() != worldRenderer->getTargetFormat())
+    worldRenderer->setupPipelines(swapchain->getCurrentFormat());
 }
 
 void Renderer::loadScene(std::filesystem::path path)
@@ -93,6 +138,10 @@ void Renderer::debugInput(const Keyboard& kb)
 {
   worldRenderer->debugInput(kb);
 
+#ifdef SHADER_HOT_RELOAD
+  if (kb[KeyboardKey::kB] == ButtonState::Falling && shaderReloader)
+    shaderReloader->recompileAll();
+#else
   if (kb[KeyboardKey::kB] == ButtonState::Falling)
   {
     const int retval = std::system("cd " GRAPHICS_COURSE_ROOT "/build"
@@ -100,12 +149,20 @@ void Renderer::debugInput(const Keyboard& kb)
     if (retval != 0)
       spdlog::warn("Shader recompilation returned a non-zero return code!");
     else
-    {
-      ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
-      etna::reload_shaders();
-      spdlog::info("Successfully reloaded shaders!");
-    }
+      reloadShaders();
   }
+#endif
+}
+
+void Renderer::reloadShaders()
+{
+  // NOTE: etna replaces the shader modules and layouts of programs in place, so the
+  // builder must be done with the old ones. The frames in flight don't need them,
+  // only the old pipelines, which setupPipelines retires instead of destroying.
+  pipelineBuilder->waitIdle();
+  etna::reload_shaders();
+  worldRenderer->setupPipelines(worldRenderer->getTargetFormat());
+  spdlog::info("Successfully reloaded shaders!");
 }
 
 void Renderer::update(const FramePacket& packet)
@@ -117,6 +174,12 @@ void Renderer::drawFrame()
 {
   ZoneScoped;
 
+#ifdef SHADER_HOT_RELOAD
+  if (shaderReloader)
+    shaderReloader->applyRecompiled([this]() { reloadShaders(); });
+#endif
+
+  if (guiRenderer)
   {
     ZoneScopedN("drawGui");
     guiRenderer->nextFrame();
@@ -125,13 +188,43 @@ void Renderer::drawFrame()
     ImGui::Render();
   }
 
-  auto currentCmdBuf = commandManager->acquireNext();
+  // Blocks until the GPU is done with the frame that used this slot before. With enough
+  // frames in flight the CPU never waits here, which the plot makes easy to see.
+  vk::CommandBuffer currentCmdBuf;
+  {
+    ZoneScopedN("waitForFrameSlot");
+    const auto waitStart = std::chrono::steady_clock::now();
+    currentCmdBuf = commandManager->acquireNext();
+    TracyPlot(
+      "Frame slot wait, ms",
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart)
+        .count());
+  }
+
+  pipelineBuilder->beginFrame();
+  if (swapchain)
+    swapchain->beginFrame();
 
   // TODO: this makes literally 0 sense here, rename/refactor,
   // it doesn't actually begin anything, just resets descriptor pools
   etna::begin_frame();
 
-  auto nextSwapchainImage = window->acquireNext();
+  if (headlessPresenter)
+  {
+    auto [image, view, availableSem] = headlessPresenter->acquireNext();
+
+    recordFrame(currentCmdBuf, image, view);
+
+    headlessPresenter->present(commandManager->submit(std::move(currentCmdBuf), availableSem));
+
+    etna::end_frame();
+    return;
+  }
+
+  for (const auto& time : gpuFrameTimer->takeResults())
+    TracyPlot("GPU frame, ms", time.milliseconds);
+
+  auto nextSwapchainImage = swapchain->acquireNext();
 
   // NOTE: here, we skip frames when the window is in the process of being
   // re-sized. This is not mandatory, it is possible to submit frames to a
@@ -141,35 +234,11 @@ void Renderer::drawFrame()
   {
     auto [image, view, availableSem] = *nextSwapchainImage;
 
-    ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
-    {
-      ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+    recordFrame(currentCmdBuf, image, view);
 
-      worldRenderer->renderWorld(currentCmdBuf, image, view);
+    auto renderingDone = commandManager->submit(std::move(currentCmdBuf), availableSem);
 
-      {
-        ImDrawData* pDrawData = ImGui::GetDrawData();
-        guiRenderer->render(
-          currentCmdBuf, {{0, 0}, {resolution.x, resolution.y}}, image, view, pDrawData);
-      }
-
-      etna::set_state(
-        currentCmdBuf,
-        image,
-        vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-        {},
-        vk::ImageLayout::ePresentSrcKHR,
-        vk::ImageAspectFlagBits::eColor);
-
-      etna::flush_barriers(currentCmdBuf);
-
-      ETNA_READ_BACK_GPU_PROFILING(currentCmdBuf);
-    }
-    ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
-
-    auto renderingDone = commandManager->submit(std::move(currentCmdBuf), std::move(availableSem));
-
-    const bool presented = window->present(std::move(renderingDone), view);
+    const bool presented = swapchain->present(renderingDone, view);
 
     if (!presented)
       nextSwapchainImage = std::nullopt;
@@ -187,6 +256,67 @@ void Renderer::drawFrame()
   }
 }
 
+void Renderer::recordFrame(vk::CommandBuffer cmd_buf, vk::Image image, vk::ImageView view)
+{
+  ETNA_CHECK_VK_RESULT(cmd_buf.begin(vk::CommandBufferBeginInfo{}));
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderFrame);
+    gpuFrameTimer->begin(cmd_buf);
+
+    if (swapchain)
+      swapchain->prepareImage(cmd_buf, image);
+
+    worldRenderer->renderWorld(cmd_buf, image, view);
+
+    if (guiRenderer)
+    {
+      ImDrawData* pDrawData = ImGui::GetDrawData();
+      guiRenderer->render(cmd_buf, {{0, 0}, {resolution.x, resolution.y}}, image, view, pDrawData);
+    }
+
+    // Offscreen images are never presented, so they are left as they are
+    if (swapchain)
+      etna::set_state(
+        cmd_buf,
+        image,
+        vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+        {},
+        vk::ImageLayout::ePresentSrcKHR,
+        vk::ImageAspectFlagBits::eColor);
+
+    etna::flush_barriers(cmd_buf);
+
+    gpuFrameTimer->end(cmd_buf);
+    ETNA_READ_BACK_GPU_PROFILING(cmd_buf);
+  }
+  ETNA_CHECK_VK_RESULT(cmd_buf.end());
+}
+
+std::vector<GpuFrameTime> Renderer::takeGpuFrameTimes()
+{
+  return gpuFrameTimer->takeResults();
+}
+
+bool Renderer::isLoadingScene() const
+{
+  return worldRenderer->isLoadingScene();
+}
+
+WorldRenderer::FrameStats Renderer::getFrameStats() const
+{
+  return worldRenderer->getFrameStats();
+}
+
+void Renderer::setGpuCulling(bool enabled)
+{
+  worldRenderer->setGpuCulling(enabled);
+}
+
+void Renderer::waitIdle()
+{
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+}
+
 Renderer::~Renderer()
 {
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
@@ -5,6 +5,14 @@
 #include <glm/glm.hpp>
 #include <function2/function2.hpp>
 
+#include "render_utils/GpuFrameTimer.hpp"
+#include "render_utils/HeadlessPresenter.hpp"
+#include "render_utils/PersistentPipelineCache.hpp"
+#include "render_utils/PipelineBuilder.hpp"
+#include "render_utils/Swapchain.hpp"
+#ifdef SHADER_HOT_RELOAD
+#include "render_utils/ShaderHotReloader.hpp"
+#endif
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -22,12 +30,15 @@ using ResolutionProvider = fu2::unique_function<glm::uvec2() const>;
 class Renderer
 {
 public:
-  explicit Renderer(glm::uvec2 resolution);
+  // Up to `frames_in_flight` frames are recorded by the CPU before waiting for the GPU
+  Renderer(glm::uvec2 resolution, std::uint32_t frames_in_flight);
   ~Renderer();
 
   // Initializing all of rendering is a tricky multi-step dance
   void initVulkan(std::span<const char*> instance_extensions);
   void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  // Alternative to initFrameDelivery, renders into offscreen images without a window or GUI
+  void initHeadless();
   void recreateSwapchain(glm::uvec2 res);
   void loadScene(std::filesystem::path path);
 
@@ -35,13 +46,35 @@ public:
   void update(const FramePacket& packet);
   void drawFrame();
 
+  // GPU times of the frames finished since the last call. They are collected in both modes,
+  // but windowed drawFrame takes them itself for the Tracy plot, so use this in headless mode.
+  std::vector<GpuFrameTime> takeGpuFrameTimes();
+  bool isLoadingScene() const;
+  WorldRenderer::FrameStats getFrameStats() const;
+  void setGpuCulling(bool enabled);
+  void waitIdle();
+
+private:
+  void recordFrame(vk::CommandBuffer cmd_buf, vk::Image image, vk::ImageView view);
+  // Reloads the SPIR-V of every program and registers their pipelines again
+  void reloadShaders();
+
 
 private:
   ResolutionProvider resolutionProvider;
-  std::unique_ptr<etna::Window> window;
+  std::unique_ptr<Swapchain> swapchain;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
+#ifdef SHADER_HOT_RELOAD
+  std::unique_ptr<ShaderHotReloader> shaderReloader;
+#endif
+  std::unique_ptr<HeadlessPresenter> headlessPresenter;
+  std::unique_ptr<GpuFrameTimer> gpuFrameTimer;
 
   glm::uvec2 resolution;
+  std::uint32_t framesInFlight;
+  std::unique_ptr<PersistentPipelineCache> pipelineCache;
+  // Declared after the cache, so that it is destroyed before it
+  std::unique_ptr<PipelineBuilder> pipelineBuilder;
   std::unique_ptr<ImGuiRenderer> guiRenderer;
 
   std::unique_ptr<WorldRenderer> worldRenderer;
@@ -1,15 +1,110 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <utility>
+
+#include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
-#include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
 #include <imgui.h>
 
 
-WorldRenderer::WorldRenderer()
-  : sceneMgr{std::make_unique<SceneManager>()}
+// Passes of a frame in the order they are recorded in, used for transient target lifetimes
+enum RenderPass : std::uint32_t
+{
+  CULL_PASS,
+  SHADOW_PASS,
+  FORWARD_PASS,
+  DEBUG_QUAD_PASS,
+};
+
+static constexpr vk::PipelineRasterizationStateCreateInfo BACK_FACE_CULLING{
+  .polygonMode = vk::PolygonMode::eFill,
+  .cullMode = vk::CullModeFlagBits::eBack,
+  .frontFace = vk::FrontFace::eCounterClockwise,
+  .lineWidth = 1.f,
+};
+
+// Side of the debug view of the shadow map in the corner of the screen
+static constexpr std::uint32_t DEBUG_QUAD_SIZE = 512;
+
+// Size of a single cascade tile of the shadow map atlas
+static constexpr std::uint32_t SHADOW_CASCADE_RESOLUTION = 2048;
+
+// Programs of baked scenes read their vertices in the BakedVertex format
+static std::string material_program_name(MaterialPermutation permutation, bool baked_vertices)
+{
+  return permutation.programName() + (baked_vertices ? "_baked" : "");
+}
+
+// The coarsest LOD that is indistinguishable from the original one
+static std::size_t select_lod(
+  std::span<const RenderElementLod> lods, float lod_scale, float max_error)
+{
+  std::size_t lodIdx = 0;
+  while (lodIdx + 1 < lods.size() && lods[lodIdx + 1].error * lod_scale <= max_error)
+    ++lodIdx;
+  return lodIdx;
+}
+
+// Texels of a cascade tile covered by a world-space sphere, with a texel of margin
+static std::optional<vk::Rect2D> sphere_texel_rect(
+  const glm::mat4x4& cascade_matrix, float extent, glm::vec4 sphere)
+{
+  const float res = float(SHADOW_CASCADE_RESOLUTION);
+  const glm::vec4 ndc = cascade_matrix * glm::vec4(glm::vec3(sphere), 1.0f);
+  const glm::vec2 center = (glm::vec2(ndc) * 0.5f + 0.5f) * res;
+  const float radius = sphere.w / extent * 0.5f * res;
+
+  const glm::vec2 min = glm::max(glm::floor(center - radius) - 1.0f, glm::vec2(0.0f));
+  const glm::vec2 max = glm::min(glm::ceil(center + radius) + 1.0f, glm::vec2(res));
+  if (min.x >= max.x || min.y >= max.y)
+    return std::nullopt;
+
+  return vk::Rect2D{
+    {static_cast<std::int32_t>(min.x), static_cast<std::int32_t>(min.y)},
+    {static_cast<std::uint32_t>(max.x - min.x), static_cast<std::uint32_t>(max.y - min.y)}};
+}
+
+static vk::Rect2D rect_union(const vk::Rect2D& a, const vk::Rect2D& b)
+{
+  const std::int32_t x0 = std::min(a.offset.x, b.offset.x);
+  const std::int32_t y0 = std::min(a.offset.y, b.offset.y);
+  const std::int32_t x1 = std::max(
+    a.offset.x + static_cast<std::int32_t>(a.extent.width),
+    b.offset.x + static_cast<std::int32_t>(b.extent.width));
+  const std::int32_t y1 = std::max(
+    a.offset.y + static_cast<std::int32_t>(a.extent.height),
+    b.offset.y + static_cast<std::int32_t>(b.extent.height));
+  return {{x0, y0}, {static_cast<std::uint32_t>(x1 - x0), static_cast<std::uint32_t>(y1 - y0)}};
+}
+
+// Stretches the part of the cascade inside `rect` to the whole clip space,
+// so that frustum culling with the result only keeps instances touching the rect
+static glm::mat4x4 crop_to_rect(const glm::mat4x4& cascade_matrix, const vk::Rect2D& rect)
+{
+  const float res = float(SHADOW_CASCADE_RESOLUTION);
+  const glm::vec2 min = glm::vec2(rect.offset.x, rect.offset.y) / res * 2.0f - 1.0f;
+  const glm::vec2 max =
+    glm::vec2(rect.offset.x + rect.extent.width, rect.offset.y + rect.extent.height) / res * 2.0f
+    - 1.0f;
+
+  glm::mat4x4 crop{1.0f};
+  crop[0][0] = 2.0f / (max.x - min.x);
+  crop[1][1] = 2.0f / (max.y - min.y);
+  crop[3][0] = -(max.x + min.x) / (max.x - min.x);
+  crop[3][1] = -(max.y + min.y) / (max.y - min.y);
+  return crop * cascade_matrix;
+}
+
+WorldRenderer::WorldRenderer(PipelineBuilder& pipeline_builder)
+  : pipelineBuilder{pipeline_builder}
+  , sceneMgr{std::make_unique<SceneManager>(SceneManager::CreateInfo{.positionStream = true})}
 {
 }
 
@@ -19,15 +114,9 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
   auto& ctx = etna::get_context();
 
-  mainViewDepth = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
-    .name = "main_view_depth",
-    .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
-  });
-
+  const std::uint32_t shadowAtlasSize = SHADOW_CASCADE_RESOLUTION * SHADOW_ATLAS_GRID;
   shadowMap = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{2048, 2048, 1},
+    .extent = vk::Extent3D{shadowAtlasSize, shadowAtlasSize, 1},
     .name = "shadow_map",
     .format = vk::Format::eD16Unorm,
     .imageUsage =
@@ -35,161 +124,496 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
   });
 
   defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
-  constants = ctx.createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(UniformParams),
-    .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
-    .name = "constants",
+  // Every frame in flight gets its own copy, so that the CPU never writes into
+  // a buffer the GPU might still be reading from
+  constants.emplace(ctx.getMainWorkCount(), [&ctx](std::size_t) {
+    auto buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = sizeof(UniformParams),
+      .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = "constants",
+    });
+    buffer.map();
+    return buffer;
   });
 
-  constants.map();
+  // The new shadow map has no cached cascades
+  for (auto& cascade : cascades)
+    cascade.renderedMatrix.reset();
+}
+
+void WorldRenderer::resize(glm::uvec2 swapchain_resolution)
+{
+  // Targets of the new size are declared with the next frame, the pool recreates them
+  // then and retires the old ones until the frames in flight are done with them.
+  resolution = swapchain_resolution;
 }
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScene(path);
+  loadingBakedScene = path.stem().string().ends_with("_baked");
+  if (loadingBakedScene)
+    sceneMgr->selectBakedSceneAsync(path);
+  else
+    sceneMgr->selectSceneAsync(path);
+
+  // The pipeline for the vertices of the new scene is built while it loads
+  if (targetFormat != vk::Format::eUndefined)
+    getMaterialPipeline(materialPermutation, loadingBakedScene);
 }
 
-void WorldRenderer::loadShaders()
+void WorldRenderer::loadShaders(const std::filesystem::path& shaders_root)
 {
-  etna::create_program(
-    "simple_material",
-    {SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv", SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
-  etna::create_program("simple_shadow", {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+  for (std::uint32_t i = 0; i < MaterialPermutation::COUNT; ++i)
+  {
+    const auto permutation = MaterialPermutation::fromIndex(i);
+    const auto fragment = shaders_root / ("simple_shadow_p" + std::to_string(i) + ".frag.spv");
+    etna::create_program(
+      material_program_name(permutation, false), {fragment, shaders_root / "simple.vert.spv"});
+    etna::create_program(
+      material_program_name(permutation, true),
+      {fragment, shaders_root / "simple_baked.vert.spv"});
+  }
+  etna::create_program("simple_shadow", {shaders_root / "shadow.vert.spv"});
+  etna::create_program("cull_instances", {shaders_root / "cull_instances.comp.spv"});
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
-  quadRenderer = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
-    .format = swapchain_format,
-    .rect = {{0, 0}, {512, 512}},
-  });
+  targetFormat = swapchain_format;
 
-  etna::VertexShaderInputDescription sceneVertexInputDesc{
-    .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
-    }},
+  // NOTE: frames in flight may still be using the old pipelines
+  const auto replace = [this](AsyncPipeline& pipeline, AsyncPipeline new_pipeline) {
+    pipelineBuilder.retire(std::exchange(pipeline, std::move(new_pipeline)));
   };
 
-
-  auto& pipelineManager = etna::get_context().getPipelineManager();
-
-  basicForwardPipeline = {};
-  basicForwardPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_material",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
+  // Other permutations are built once they are selected, see getMaterialPipeline
+  for (auto& pipeline : materialPipelines)
+    pipelineBuilder.retire(std::exchange(pipeline, AsyncPipeline{}));
+  getMaterialPipeline(materialPermutation, bakedScene);
+  if (sceneMgr->isLoading())
+    getMaterialPipeline(materialPermutation, loadingBakedScene);
+
+  replace(
+    shadowPipeline,
+    pipelineBuilder.buildGraphics(
+      "simple_shadow",
+      PipelineBuilder::GraphicsPipelineInfo{
+        .vertexInput = sceneMgr->getPositionFormatDescription(),
+        .rasterizationConfig = BACK_FACE_CULLING,
+        .depthAttachmentFormat = vk::Format::eD16Unorm,
+      }));
+
+  replace(cullPipeline, pipelineBuilder.buildCompute("cull_instances"));
+
+  if (quadRenderer)
+    pipelineBuilder.retire(quadRenderer->getPipeline());
+  quadRenderer = std::make_unique<QuadRenderer>(
+    pipelineBuilder,
+    QuadRenderer::CreateInfo{
+      .format = targetFormat,
+      .rect = {{0, 0}, {DEBUG_QUAD_SIZE, DEBUG_QUAD_SIZE}},
     });
+}
 
-  shadowPipeline = {};
-  shadowPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_shadow",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .depthAttachmentFormat = vk::Format::eD16Unorm,
-        },
-    });
+const AsyncPipeline& WorldRenderer::getMaterialPipeline(
+  MaterialPermutation permutation, bool baked_vertices)
+{
+  auto& pipeline =
+    materialPipelines[permutation.index() + (baked_vertices ? MaterialPermutation::COUNT : 0)];
+  if (!pipeline)
+    pipeline = pipelineBuilder.buildGraphics(
+      material_program_name(permutation, baked_vertices),
+      PipelineBuilder::GraphicsPipelineInfo{
+        .vertexInput = baked_vertices ? sceneMgr->getBakedVertexFormatDescription()
+                                      : sceneMgr->getVertexFormatDescription(),
+        .rasterizationConfig = BACK_FACE_CULLING,
+        .colorAttachmentFormats = {targetFormat},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      });
+  return pipeline;
 }
 
 void WorldRenderer::debugInput(const Keyboard& kb)
 {
   if (kb[KeyboardKey::kQ] == ButtonState::Falling)
     drawDebugFSQuad = !drawDebugFSQuad;
-
-  if (kb[KeyboardKey::kP] == ButtonState::Falling)
-    lightProps.usePerspectiveM = !lightProps.usePerspectiveM;
 }
 
 void WorldRenderer::update(const FramePacket& packet)
 {
   ZoneScoped;
 
-  // calc camera matrix
+  // This is the frame boundary, so a freshly loaded scene may be swapped in here
+  if (sceneMgr->update())
   {
-    const float aspect = float(resolution.x) / float(resolution.y);
-    worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+    bakedScene = loadingBakedScene;
+    for (auto& cascade : cascades)
+      cascade.renderedMatrix.reset();
+    animationBases.clear();
   }
 
-  // calc light matrix
+  animateInstances(packet.currentTime);
+
+  const float aspect = float(resolution.x) / float(resolution.y);
+
+  // calc camera matrix
+  worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+
+  // calc light matrices
+  updateCascades(packet.mainCam, packet.shadowCam, aspect);
+  lightPos = packet.shadowCam.position;
+
+  lodParams = LodParams{
+    .cameraPos = packet.mainCam.position,
+    .zNear = packet.mainCam.zNear,
+    .pixelsPerUnit =
+      float(resolution.y) / (2.0f * std::tan(glm::radians(packet.mainCam.fov) / 2.0f)),
+  };
+
+  prepareIndirectDraws();
+
+  // Instances outside of a view are skipped when recording its draws,
+  // GPU culling does the same thing in cullOnGpu instead
+  if (!useGpuCulling)
   {
-    const auto mProj = lightProps.usePerspectiveM
-      ? glm::perspectiveLH_ZO(
-          -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f)
-      : glm::orthoLH_ZO(
-          +lightProps.radius,
-          -lightProps.radius,
-          +lightProps.radius,
-          -lightProps.radius,
-          0.0f,
-          lightProps.lightTargetDist);
-
-    lightMatrix = mProj * packet.shadowCam.viewTm();
-
-    lightPos = packet.shadowCam.position;
+    ZoneScopedN("cullInstances");
+
+    const auto& spheres = sceneMgr->getInstanceBoundingSpheres();
+    cull_spheres(spheres, extract_frustum_planes(worldViewProj), mainViewVisible);
+    for (auto& cascade : cascades)
+      if (cascade.redrawRect.has_value())
+        cull_spheres(spheres, extract_frustum_planes(cascade.cullMatrix), cascade.visible);
+
+    updateLodScales();
   }
 
-  // Upload everything to GPU-mapped memory
+  // Uploaded to GPU-mapped memory in renderWorld
   {
-    uniformParams.lightMatrix = lightMatrix;
+    for (std::size_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+      uniformParams.cascadeMatrices[i] = cascades[i].matrix;
     uniformParams.lightPos = lightPos;
     uniformParams.time = packet.currentTime;
+  }
+}
+
+void WorldRenderer::updateLodScales()
+{
+  ZoneScoped;
+
+  // Measured at the point of the bounding sphere closest to the camera. Shadow cascades
+  // draw instances outside of the main view too, so every instance gets a scale.
+  // NOTE: cached cascades keep the LODs they were drawn with until they are redrawn.
+  const auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  const auto& spheres = sceneMgr->getInstanceBoundingSpheres();
 
-    std::memcpy(constants.data(), &uniformParams, sizeof(uniformParams));
+  instanceLodScales.resize(instanceMatrices.size());
+  for (std::size_t i = 0; i < instanceMatrices.size(); ++i)
+  {
+    const auto& m = instanceMatrices[i];
+    const float scale = std::max(
+      {glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+    const glm::vec3 center{spheres.x[i], spheres.y[i], spheres.z[i]};
+    const float distance = std::max(
+      glm::distance(center, lodParams.cameraPos) - spheres.radius[i], lodParams.zNear);
+    instanceLodScales[i] = lodParams.pixelsPerUnit * scale / distance;
+  }
+}
+
+void WorldRenderer::animateInstances(float time)
+{
+  const auto matrices = sceneMgr->getInstanceMatrices();
+  const std::size_t count =
+    std::min(static_cast<std::size_t>(std::max(animatedInstanceCount, 0)), matrices.size());
+
+  // Instances that are not animated anymore are put back into place
+  while (animationBases.size() > count)
+  {
+    const auto instIdx = static_cast<std::uint32_t>(animationBases.size() - 1);
+    sceneMgr->setInstanceMatrix(instIdx, animationBases.back());
+    animationBases.pop_back();
+  }
+
+  while (animationBases.size() < count)
+    animationBases.push_back(matrices[animationBases.size()]);
+
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const glm::vec3 offset{0.0f, 0.5f * std::sin(2.0f * time + float(i)), 0.0f};
+    sceneMgr->setInstanceMatrix(
+      static_cast<std::uint32_t>(i),
+      glm::translate(glm::identity<glm::mat4x4>(), offset) * animationBases[i]);
   }
 }
 
+void WorldRenderer::updateCascades(const Camera& main_cam, const Camera& light_cam, float aspect)
+{
+  // The light looks along +Z of its view space. The view is not translated, so
+  // snapping cascade centers to a grid in it does not depend on the camera position.
+  const glm::mat4x4 lightView = glm::mat4_cast(glm::inverse(light_cam.rotation));
+  const glm::mat3x3 lightRotation{lightView};
+
+  const float nearPlane = main_cam.zNear;
+  const float farPlane = std::min(main_cam.zFar, lightProps.shadowDistance);
+  const float tanHalfFov = std::tan(glm::radians(main_cam.fov) * 0.5f);
+  // Squared distance of slice corners from the view axis per unit of depth
+  const float cornerSlope2 = tanHalfFov * tanHalfFov * (1.0f + aspect * aspect);
+
+  float sliceNear = nearPlane;
+  for (std::size_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    auto& cascade = cascades[i];
+
+    // "Practical" split scheme from Zhang et al. "Parallel-Split Shadow Maps"
+    const float t = float(i + 1) / float(SHADOW_CASCADE_COUNT);
+    const float sliceFar = glm::mix(
+      nearPlane + (farPlane - nearPlane) * t,
+      nearPlane * std::pow(farPlane / nearPlane, t),
+      lightProps.splitLambda);
+
+    // The smallest sphere around the slice, placed on the view axis. Its radius
+    // does not change when the camera moves or turns, so neither does the size
+    // of shadow map texels, and shadow edges don't shimmer.
+    const float centerDist =
+      std::min(0.5f * (sliceNear + sliceFar) * (1.0f + cornerSlope2), sliceFar);
+    const float radius = std::sqrt(
+      (sliceFar - centerDist) * (sliceFar - centerDist) + sliceFar * sliceFar * cornerSlope2);
+    sliceNear = sliceFar;
+
+    // Cached cascades are a bit bigger than the slice and only move in steps of 1/8
+    // of their radius, so that the slice stays inside while the camera is in a cell.
+    const bool cached = i >= lightProps.firstCachedCascade;
+    const float extent = cached ? radius * 1.125f : radius;
+    const float texel = 2.0f * extent / float(SHADOW_CASCADE_RESOLUTION);
+    const float step = cached ? std::ceil(radius / 8.0f / texel) * texel : texel;
+
+    glm::vec3 center = lightRotation * (main_cam.position + main_cam.forward() * centerDist);
+    center.x = std::round(center.x / step) * step;
+    center.y = std::round(center.y / step) * step;
+
+    // NOTE: both X and Y are flipped to match the handedness of Camera
+    const glm::mat4x4 proj = glm::orthoLH_ZO(
+      center.x + extent,
+      center.x - extent,
+      center.y + extent,
+      center.y - extent,
+      center.z - extent - lightProps.casterDistance,
+      center.z + extent);
+
+    cascade.matrix = proj * lightView;
+    cascade.extent = extent;
+
+    // Moved instances are redrawn both where they are now and where they used to be
+    if (cascade.renderedMatrix != cascade.matrix)
+      cascade.redrawRect =
+        vk::Rect2D{{0, 0}, {SHADOW_CASCADE_RESOLUTION, SHADOW_CASCADE_RESOLUTION}};
+    else
+    {
+      cascade.redrawRect.reset();
+      const auto& spheres = sceneMgr->getInstanceBoundingSpheres();
+      for (const auto& moved : sceneMgr->getMovedInstances())
+        for (const glm::vec4 sphere : {moved.oldSphere, spheres.get(moved.instance)})
+          if (const auto rect = sphere_texel_rect(cascade.matrix, extent, sphere))
+            cascade.redrawRect =
+              cascade.redrawRect.has_value() ? rect_union(*cascade.redrawRect, *rect) : *rect;
+    }
+
+    if (cascade.redrawRect.has_value())
+      cascade.cullMatrix = crop_to_rect(cascade.matrix, *cascade.redrawRect);
+  }
+}
+
+void WorldRenderer::prepareIndirectDraws()
+{
+  // Every relem of every instance is drawn at most once per view
+  const std::uint32_t maxDraws = sceneMgr->getRelemInstanceCount();
+  if (maxDraws <= indirectDrawCapacity)
+    return;
+
+  // NOTE: this only happens when a bigger scene is swapped in,
+  // so simply waiting for the frames in flight is fine.
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+
+  auto& ctx = etna::get_context();
+  const auto createDraws = [&ctx, maxDraws](const char* name) {
+    return IndirectDraws{
+      .commands = ctx.createBuffer(etna::Buffer::CreateInfo{
+        .size = maxDraws * sizeof(vk::DrawIndexedIndirectCommand),
+        .bufferUsage =
+          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+        .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .name = name,
+      }),
+      .count = ctx.createBuffer(etna::Buffer::CreateInfo{
+        .size = sizeof(std::uint32_t),
+        .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+          vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .name = name,
+      }),
+    };
+  };
+
+  mainViewDraws = createDraws("main_view_draws");
+  for (auto& cascade : cascades)
+    cascade.draws = createDraws("shadow_cascade_draws");
+  indirectDrawCapacity = maxDraws;
+}
+
+void WorldRenderer::cullOnGpu(
+  vk::CommandBuffer cmd_buf, const glm::mat4x4& proj_view, const IndirectDraws& draws)
+{
+  const auto barrier = [cmd_buf](
+                         vk::PipelineStageFlags2 src_stage,
+                         vk::AccessFlags2 src_access,
+                         vk::PipelineStageFlags2 dst_stage,
+                         vk::AccessFlags2 dst_access) {
+    const vk::MemoryBarrier2 memoryBarrier{
+      .srcStageMask = src_stage,
+      .srcAccessMask = src_access,
+      .dstStageMask = dst_stage,
+      .dstAccessMask = dst_access,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &memoryBarrier,
+    });
+  };
+
+  // The previous frame might still be drawing with these commands
+  barrier(
+    vk::PipelineStageFlagBits2::eDrawIndirect,
+    vk::AccessFlagBits2::eIndirectCommandRead,
+    vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eShaderStorageWrite);
+
+  cmd_buf.fillBuffer(draws.count.get(), 0, sizeof(std::uint32_t), 0);
+
+  barrier(
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+  auto cullInfo = etna::get_shader_program("cull_instances");
+
+  auto set = etna::create_descriptor_set(
+    cullInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, sceneMgr->getInstanceMatricesBuffer().genBinding()},
+      etna::Binding{1, sceneMgr->getInstanceMeshesBuffer().genBinding()},
+      etna::Binding{2, sceneMgr->getMeshesBuffer().genBinding()},
+      etna::Binding{3, sceneMgr->getMeshSpheresBuffer().genBinding()},
+      etna::Binding{4, sceneMgr->getRenderElementsBuffer().genBinding()},
+      etna::Binding{5, draws.commands.genBinding()},
+      etna::Binding{6, draws.count.genBinding()},
+      etna::Binding{7, sceneMgr->getRenderElementLodsBuffer().genBinding()},
+    });
+
+  const CullingParams params{
+    .planes = extract_frustum_planes(proj_view),
+    .lodCameraAndNear = glm::vec4(lodParams.cameraPos, lodParams.zNear),
+    .pixelsPerUnit = lodParams.pixelsPerUnit,
+    .maxLodError = lodErrorThreshold,
+    .instanceCount = static_cast<std::uint32_t>(sceneMgr->getInstanceMeshes().size()),
+  };
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, cullPipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<CullingParams>(
+    cullPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch((params.instanceCount + 63) / 64, 1, 1);
+
+  barrier(
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eDrawIndirect,
+    vk::AccessFlagBits2::eIndirectCommandRead);
+}
+
 void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout,
+  vk::Buffer vertex_buffer,
+  std::span<const std::uint32_t> visible_instances,
+  const IndirectDraws& indirect_draws)
 {
-  if (!sceneMgr->getVertexBuffer())
+  if (!vertex_buffer || indirectDrawCapacity == 0)
     return;
 
-  cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
+  cmd_buf.bindVertexBuffers(0, {vertex_buffer}, {0});
   cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
   pushConst2M.projView = glob_tm;
 
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+
+  if (useGpuCulling)
+  {
+    cmd_buf.drawIndexedIndirectCount(
+      indirect_draws.commands.get(),
+      0,
+      indirect_draws.count.get(),
+      0,
+      sceneMgr->getRelemInstanceCount(),
+      sizeof(vk::DrawIndexedIndirectCommand));
+    ++drawCallCount;
+    return;
+  }
+
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
+  auto lods = sceneMgr->getRenderElementLods();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  // Instances are sorted by mesh and visible ones are listed in order, so every run
+  // of consecutive visible instances of the same mesh is drawn with a single instanced
+  // draw per relem and LOD. The shader reads model matrices by gl_InstanceIndex.
+  for (std::size_t i = 0; i < visible_instances.size();)
   {
-    pushConst2M.model = instanceMatrices[instIdx];
-
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+    const std::uint32_t firstInstance = visible_instances[i];
+    const auto meshIdx = instanceMeshes[firstInstance];
 
-    const auto meshIdx = instanceMeshes[instIdx];
+    std::uint32_t instanceCount = 1;
+    while (i + instanceCount < visible_instances.size()
+      && visible_instances[i + instanceCount] == firstInstance + instanceCount
+      && instanceMeshes[firstInstance + instanceCount] == meshIdx)
+      ++instanceCount;
+    i += instanceCount;
 
     for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      const auto relemLods = lods.subspan(relem.firstLod, relem.lodCount);
+      const auto lodOf = [this, relemLods](std::uint32_t instance) {
+        return select_lod(relemLods, instanceLodScales[instance], lodErrorThreshold);
+      };
+
+      // Neighbouring instances mostly pick the same LOD, which splits the run rarely
+      for (std::uint32_t k = 0; k < instanceCount;)
+      {
+        const std::size_t lodIdx = lodOf(firstInstance + k);
+        std::uint32_t lodInstanceCount = 1;
+        while (k + lodInstanceCount < instanceCount
+          && lodOf(firstInstance + k + lodInstanceCount) == lodIdx)
+          ++lodInstanceCount;
+
+        const auto& lod = relemLods[lodIdx];
+        cmd_buf.drawIndexed(
+          lod.indexCount, lodInstanceCount, lod.indexOffset, relem.vertexOffset, firstInstance + k);
+        triangleCount += lod.indexCount / 3 * lodInstanceCount;
+        ++drawCallCount;
+        k += lodInstanceCount;
+      }
     }
   }
 }
@@ -199,54 +623,221 @@ void WorldRenderer::renderWorld(
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
-  // draw scene to shadowmap
+  const auto recordStart = std::chrono::steady_clock::now();
+  drawCallCount = 0;
+  triangleCount = 0;
+
+  // NOTE: the GPU is guaranteed to be done with the buffers of the current frame slot
+  // only once its command buffer is acquired, so this can't happen in update.
+  auto& frameConstants = constants->get();
+  std::memcpy(frameConstants.data(), &uniformParams, sizeof(uniformParams));
+
+  sceneMgr->recordInstanceUpdates(cmd_buf);
+
+  transientTargets.beginFrame();
+  const auto mainViewDepth = transientTargets.declare(
+    TransientImagePool::ImageDesc{
+      .name = "main_view_depth",
+      .extent = vk::Extent2D{resolution.x, resolution.y},
+      .format = vk::Format::eD32Sfloat,
+      .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+      .aspect = vk::ImageAspectFlagBits::eDepth,
+      .firstLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+    },
+    FORWARD_PASS,
+    FORWARD_PASS);
+  // The debug quad is drawn off screen and copied over the frame afterwards. It only lives
+  // after the main view depth is done, so the two share memory and declaring the quad
+  // every frame costs nothing, while toggling it would make the pool recreate its images.
+  const auto debugQuad = transientTargets.declare(
+    TransientImagePool::ImageDesc{
+      .name = "debug_quad",
+      .extent = vk::Extent2D{DEBUG_QUAD_SIZE, DEBUG_QUAD_SIZE},
+      .format = targetFormat,
+      .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+      .firstLayout = vk::ImageLayout::eColorAttachmentOptimal,
+    },
+    DEBUG_QUAD_PASS,
+    DEBUG_QUAD_PASS);
+  transientTargets.compile();
+
+  // cull instances for all views before any rendering starts
+
+  if (useGpuCulling && sceneMgr->getVertexBuffer() && indirectDrawCapacity > 0)
+  {
+    ETNA_PROFILE_GPU(cmd_buf, cullInstances);
+
+    for (const auto& cascade : cascades)
+      if (cascade.redrawRect.has_value())
+        cullOnGpu(cmd_buf, cascade.cullMatrix, cascade.draws);
+    cullOnGpu(cmd_buf, worldViewProj, mainViewDraws);
+  }
+
+  // draw scene to the parts of the shadowmap cascades that are not cached
 
+  cascadesRedrawn = 0;
+  cascadesPartiallyRedrawn = 0;
+
+  const bool anyCascadeRedrawn = std::any_of(
+    cascades.begin(), cascades.end(), [](const auto& c) { return c.redrawRect.has_value(); });
+  if (anyCascadeRedrawn)
   {
     ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
 
-    etna::RenderTargetState renderTargets(
+    auto simpleShadowInfo = etna::get_shader_program("simple_shadow");
+
+    auto set = etna::create_descriptor_set(
+      simpleShadowInfo.getDescriptorLayoutId(0),
       cmd_buf,
-      {{0, 0}, {2048, 2048}},
-      {},
-      {.image = shadowMap.get(), .view = shadowMap.getView({})});
+      {etna::Binding{2, sceneMgr->getInstanceMatricesBuffer().genBinding()}});
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
+    for (std::size_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+    {
+      auto& cascade = cascades[i];
+      if (!cascade.redrawRect.has_value())
+        continue;
+
+      const vk::Offset2D tileOffset{
+        static_cast<std::int32_t>(i % SHADOW_ATLAS_GRID * SHADOW_CASCADE_RESOLUTION),
+        static_cast<std::int32_t>(i / SHADOW_ATLAS_GRID * SHADOW_CASCADE_RESOLUTION)};
+      const vk::Rect2D redrawArea{
+        {tileOffset.x + cascade.redrawRect->offset.x, tileOffset.y + cascade.redrawRect->offset.y},
+        cascade.redrawRect->extent};
+
+      // NOTE: only the redrawn area is cleared, the rest of the atlas is kept
+      etna::RenderTargetState renderTargets(
+        cmd_buf, redrawArea, {}, {.image = shadowMap.get(), .view = shadowMap.getView({})});
+
+      // The projection still covers the whole tile, the scissor clips it to the redrawn area
+      cmd_buf.setViewport(
+        0,
+        {vk::Viewport{
+          .x = static_cast<float>(tileOffset.x),
+          .y = static_cast<float>(tileOffset.y),
+          .width = static_cast<float>(SHADOW_CASCADE_RESOLUTION),
+          .height = static_cast<float>(SHADOW_CASCADE_RESOLUTION),
+          .minDepth = 0.0f,
+          .maxDepth = 1.0f,
+        }});
+      cmd_buf.setScissor(0, {redrawArea});
+
+      cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+      cmd_buf.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics,
+        shadowPipeline.getVkPipelineLayout(),
+        0,
+        {set.getVkSet()},
+        {});
+
+      renderScene(
+        cmd_buf,
+        cascade.matrix,
+        shadowPipeline.getVkPipelineLayout(),
+        sceneMgr->getPositionBuffer(),
+        cascade.visible,
+        cascade.draws);
+
+      const bool fullRedraw = cascade.renderedMatrix != cascade.matrix;
+      cascade.renderedMatrix = cascade.matrix;
+      ++(fullRedraw ? cascadesRedrawn : cascadesPartiallyRedrawn);
+    }
   }
 
   // draw final scene to screen
 
+  transientTargets.beginPass(cmd_buf, FORWARD_PASS);
   {
     ETNA_PROFILE_GPU(cmd_buf, renderForward);
 
-    auto simpleMaterialInfo = etna::get_shader_program("simple_material");
+    const auto& materialPipeline = getMaterialPipeline(materialPermutation, bakedScene);
+    auto simpleMaterialInfo =
+      etna::get_shader_program(material_program_name(materialPermutation, bakedScene));
 
     auto set = etna::create_descriptor_set(
       simpleMaterialInfo.getDescriptorLayoutId(0),
       cmd_buf,
-      {etna::Binding{0, constants.genBinding()},
+      {etna::Binding{0, frameConstants.genBinding()},
        etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+       etna::Binding{2, sceneMgr->getInstanceMatricesBuffer().genBinding()},
+       etna::Binding{3, sceneMgr->getInstanceNormalMatricesBuffer().genBinding()}});
 
     etna::RenderTargetState renderTargets(
       cmd_buf,
       {{0, 0}, {resolution.x, resolution.y}},
       {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
+      {.image = transientTargets.getImage(mainViewDepth),
+       .view = transientTargets.getView(mainViewDepth)});
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, materialPipeline.getVkPipeline());
     cmd_buf.bindDescriptorSets(
       vk::PipelineBindPoint::eGraphics,
-      basicForwardPipeline.getVkPipelineLayout(),
+      materialPipeline.getVkPipelineLayout(),
       0,
       {set.getVkSet()},
       {});
 
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
+    renderScene(
+      cmd_buf,
+      worldViewProj,
+      materialPipeline.getVkPipelineLayout(),
+      sceneMgr->getVertexBuffer(),
+      mainViewVisible,
+      mainViewDraws);
   }
+  transientTargets.endPass(cmd_buf, FORWARD_PASS);
+
+  sceneRecordMs = std::chrono::duration<float, std::milli>(
+                    std::chrono::steady_clock::now() - recordStart)
+                    .count();
 
   if (drawDebugFSQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderDebugQuad);
+
+    transientTargets.beginPass(cmd_buf, DEBUG_QUAD_PASS);
+
+    const vk::Image quadImage = transientTargets.getImage(debugQuad);
+    quadRenderer->render(
+      cmd_buf, quadImage, transientTargets.getView(debugQuad), shadowMap, defaultSampler);
+
+    etna::set_state(
+      cmd_buf,
+      quadImage,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead,
+      vk::ImageLayout::eTransferSrcOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    etna::set_state(
+      cmd_buf,
+      target_image,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmd_buf);
+
+    const vk::ImageSubresourceLayers colorLayer{
+      .aspectMask = vk::ImageAspectFlagBits::eColor,
+      .mipLevel = 0,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    };
+    cmd_buf.copyImage(
+      quadImage,
+      vk::ImageLayout::eTransferSrcOptimal,
+      target_image,
+      vk::ImageLayout::eTransferDstOptimal,
+      {vk::ImageCopy{
+        .srcSubresource = colorLayer,
+        .dstSubresource = colorLayer,
+        .extent =
+          vk::Extent3D{
+            std::min(DEBUG_QUAD_SIZE, resolution.x), std::min(DEBUG_QUAD_SIZE, resolution.y), 1},
+      }});
+
+    transientTargets.endPass(cmd_buf, DEBUG_QUAD_PASS);
+  }
 }
 
 void WorldRenderer::drawGui()
@@ -267,6 +858,50 @@ void WorldRenderer::drawGui()
     1000.0f / ImGui::GetIO().Framerate,
     ImGui::GetIO().Framerate);
 
+  // Each combination is a separate shader with a pipeline of its own
+  ImGui::Checkbox("Filter shadows (PCF)", &materialPermutation.pcf);
+  ImGui::Checkbox("Animate light color", &materialPermutation.animatedLight);
+  ImGui::Checkbox("Show shadow cascades", &materialPermutation.showCascades);
+  // Starts building the pipeline of a new selection before the frame is recorded
+  getMaterialPipeline(materialPermutation, bakedScene);
+
+  ImGui::SliderFloat("Shadow distance", &lightProps.shadowDistance, 10.0f, 500.0f);
+  ImGui::SliderFloat("Cascade split lambda", &lightProps.splitLambda, 0.0f, 1.0f);
+  ImGui::SliderInt("Animated instances", &animatedInstanceCount, 0, 64);
+  ImGui::Text(
+    "Shadow cascades: %u redrawn, %u partially redrawn, %u cached",
+    cascadesRedrawn,
+    cascadesPartiallyRedrawn,
+    SHADOW_CASCADE_COUNT - cascadesRedrawn - cascadesPartiallyRedrawn);
+
+  ImGui::SliderFloat("Max LOD error, pixels", &lodErrorThreshold, 0.0f, 10.0f);
+  ImGui::Checkbox("Cull instances on GPU", &useGpuCulling);
+  ImGui::Text("Scene: %u draw calls recorded in %.3f ms", drawCallCount, sceneRecordMs);
+  if (!useGpuCulling)
+    ImGui::Text("Triangles drawn: %" PRIu64, triangleCount);
+
+  const std::size_t instanceCount = sceneMgr->getInstanceMeshes().size();
+  if (!useGpuCulling)
+  {
+    ImGui::Text(
+      "Main view: %zu instances visible, %zu culled",
+      mainViewVisible.size(),
+      instanceCount - mainViewVisible.size());
+    for (std::size_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+      if (cascades[i].redrawRect.has_value())
+        ImGui::Text(
+          "Shadow cascade %zu: %zu instances visible, %zu culled",
+          i,
+          cascades[i].visible.size(),
+          instanceCount - cascades[i].visible.size());
+  }
+
+  const auto targetStats = transientTargets.getStats();
+  ImGui::Text(
+    "Transient targets: %.1f MiB, %.1f MiB without aliasing",
+    double(targetStats.aliasedBytes) / (1024.0 * 1024.0),
+    double(targetStats.separateBytes) / (1024.0 * 1024.0));
+
   ImGui::NewLine();
 
   ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Press 'B' to recompile and reload shaders");
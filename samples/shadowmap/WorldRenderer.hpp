@@ -1,17 +1,23 @@
 #pragma once
 
+#include <array>
+#include <optional>
+
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
-#include <etna/GraphicsPipeline.hpp>
+#include <etna/GpuSharedResource.hpp>
 #include <glm/glm.hpp>
 
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
+#include "render_utils/PipelineBuilder.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "render_utils/TransientImagePool.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
+#include "MaterialPermutation.hpp"
 
 
 /**
@@ -21,13 +27,23 @@
 class WorldRenderer
 {
 public:
-  WorldRenderer();
+  // Pipelines are built by `pipeline_builder`, which has to outlive the renderer
+  explicit WorldRenderer(PipelineBuilder& pipeline_builder);
 
+  // Scenes baked by model_bakery_baker (`_baked.gltf` files) have LODs, others don't
   void loadScene(std::filesystem::path path);
+  bool isLoadingScene() const { return sceneMgr->isLoading(); }
 
-  void loadShaders();
+  // Loads the SPIR-V from `shaders_root`, the build output or its hot reload copy
+  void loadShaders(const std::filesystem::path& shaders_root);
   void allocateResources(glm::uvec2 swapchain_resolution);
+  // Only recreates the targets that depend on the resolution
+  void resize(glm::uvec2 swapchain_resolution);
+  // Registers the pipelines with the builder, the replaced ones are retired. Material
+  // permutations other than the current one are registered once they are selected.
+  // Call again after the shader programs are reloaded.
   void setupPipelines(vk::Format swapchain_format);
+  vk::Format getTargetFormat() const { return targetFormat; }
 
   void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
@@ -35,45 +51,159 @@ public:
   void renderWorld(
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
+  struct FrameStats
+  {
+    std::uint32_t drawCalls;
+    // Only counted with CPU culling, the GPU decides what to draw otherwise
+    std::uint64_t triangles;
+  };
+
+  // Statistics of the last recorded frame
+  FrameStats getFrameStats() const { return {drawCallCount, triangleCount}; }
+  void setGpuCulling(bool enabled) { useGpuCulling = enabled; }
+
 private:
+  void animateInstances(float time);
+  void updateCascades(const Camera& main_cam, const Camera& light_cam, float aspect);
+  void updateLodScales();
+  void prepareIndirectDraws();
+
+  // Draw commands of a single view, written by the culling shader
+  struct IndirectDraws
+  {
+    etna::Buffer commands;
+    etna::Buffer count;
+  };
+
+  // Registers the pipeline of `permutation` for the vertex format of regular or baked
+  // scenes with the builder on first use
+  const AsyncPipeline& getMaterialPipeline(MaterialPermutation permutation, bool baked_vertices);
+
+  void cullOnGpu(
+    vk::CommandBuffer cmd_buf, const glm::mat4x4& proj_view, const IndirectDraws& draws);
+
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout,
+    vk::Buffer vertex_buffer,
+    std::span<const std::uint32_t> visible_instances,
+    const IndirectDraws& indirect_draws);
 
 
 private:
+  PipelineBuilder& pipelineBuilder;
   std::unique_ptr<SceneManager> sceneMgr;
 
-  etna::Image mainViewDepth;
+  // Targets which only live during a part of the frame, e.g. the depth of the main view.
+  // They are recreated by the pool when their resolution changes.
+  TransientImagePool transientTargets;
+
   etna::Image shadowMap;
   etna::Sampler defaultSampler;
-  etna::Buffer constants;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> constants;
 
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
   } pushConst2M;
 
+  struct CullingParams
+  {
+    FrustumPlanes planes;
+    glm::vec4 lodCameraAndNear;
+    float pixelsPerUnit;
+    float maxLodError;
+    std::uint32_t instanceCount;
+  };
+
   glm::mat4x4 worldViewProj;
-  glm::mat4x4 lightMatrix;
   glm::vec3 lightPos;
 
+  // Indices of instances which intersect the frustum of each view, updated every frame
+  std::vector<std::uint32_t> mainViewVisible;
+
+  // LODs are selected for the main camera in every view, so that shadows are cast by the
+  // same geometry that is shown. The error of a LOD in pixels is its mesh-space error
+  // times the LOD scale of the instance, see RenderElementLod.
+  struct LodParams
+  {
+    glm::vec3 cameraPos;
+    float zNear;
+    // Size of a world-space unit in pixels at a distance of 1 from the camera
+    float pixelsPerUnit;
+  } lodParams;
+  // Max LOD error on the screen in pixels
+  float lodErrorThreshold = 1.0f;
+  // Only updated with CPU culling, the culling shader computes the same scales otherwise
+  std::vector<float> instanceLodScales;
+
+  // With GPU culling, the CPU records a single indirect draw per view, and the
+  // visible lists are not updated.
+  bool useGpuCulling = true;
+  IndirectDraws mainViewDraws;
+  std::uint32_t indirectDrawCapacity = 0;
+
+  // A tile of the shadow map atlas covering a slice of the main camera frustum.
+  // The depth of a cascade is only re-rendered when its matrix changes, and
+  // only around the instances that moved otherwise.
+  struct ShadowCascade
+  {
+    glm::mat4x4 matrix;
+    // Half of the size of the cascade in world units
+    float extent;
+    // The matrix the cached depth was rendered with, if any
+    std::optional<glm::mat4x4> renderedMatrix;
+    // Part of the tile to redraw this frame in texels, none if the cached depth is fine
+    std::optional<vk::Rect2D> redrawRect;
+    // Only keeps the instances touching the redraw rect when culling
+    glm::mat4x4 cullMatrix;
+    std::vector<std::uint32_t> visible;
+    IndirectDraws draws;
+  };
+
+  std::array<ShadowCascade, SHADOW_CASCADE_COUNT> cascades;
+  std::uint32_t cascadesRedrawn = 0;
+  std::uint32_t cascadesPartiallyRedrawn = 0;
+
+  // A few instances bob up and down to show off incremental shadow updates
+  int animatedInstanceCount = 0;
+  std::vector<glm::mat4x4> animationBases;
+
+  // Statistics of the last recorded frame
+  std::uint32_t drawCallCount = 0;
+  std::uint64_t triangleCount = 0;
+  float sceneRecordMs = 0;
+
   struct ShadowMapCam
   {
-    float radius = 10;
-    float lightTargetDist = 24;
-    bool usePerspectiveM = false;
+    // Shadows are only cast onto things closer to the camera than this
+    float shadowDistance = 60;
+    // How far behind a cascade towards the light casters are still rendered
+    float casterDistance = 50;
+    // Blend between uniform (0) and logarithmic (1) cascade splits
+    float splitLambda = 0.75f;
+    // Cascades starting with this one only move in big steps and are mostly cached
+    std::uint32_t firstCachedCascade = 2;
   } lightProps;
 
   UniformParams uniformParams{
-    .lightMatrix = {},
+    .cascadeMatrices = {},
     .lightPos = {},
     .time = {},
     .baseColor = {0.9f, 0.92f, 1.0f},
   };
 
-  etna::GraphicsPipeline basicForwardPipeline{};
-  etna::GraphicsPipeline shadowPipeline{};
+  MaterialPermutation materialPermutation;
+  // Vertices of the current scene and of the one being loaded are in the baked format
+  bool bakedScene = false;
+  bool loadingBakedScene = false;
+  // Pipelines of the permutations selected so far, the others are empty. Those for
+  // baked vertices follow the ones for regular vertices.
+  std::array<AsyncPipeline, 2 * MaterialPermutation::COUNT> materialPipelines;
+  vk::Format targetFormat = vk::Format::eUndefined;
+  AsyncPipeline shadowPipeline;
+  AsyncPipeline cullPipeline;
 
   std::unique_ptr<QuadRenderer> quadRenderer;
   bool drawDebugFSQuad = false;
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
+#include "FramePacketStream.hpp"
+#include "HeadlessApp.hpp"
+
+
+// Nearest-rank percentile, `values` must be sorted
+static double percentile(std::span<const double> values, double p)
+{
+  if (values.empty())
+    return 0;
+  const auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * double(values.size())));
+  return values[std::clamp<std::size_t>(rank, 1, values.size()) - 1];
+}
+
+// The first glTF file of a scene directory, baked scenes are skipped
+static std::filesystem::path find_scene_file(const std::filesystem::path& dir)
+{
+  std::vector<std::filesystem::path> candidates;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(dir))
+  {
+    const auto& path = entry.path();
+    const bool isGltf = path.extension() == ".gltf" || path.extension() == ".glb";
+    if (entry.is_regular_file() && isGltf && !path.stem().string().ends_with("_baked"))
+      candidates.push_back(path);
+  }
+  std::ranges::sort(candidates);
+  return candidates.empty() ? std::filesystem::path{} : candidates.front();
+}
+
+static void report(std::string_view scene, std::span<const FrameTiming> timings)
+{
+  std::vector<double> cpu;
+  std::vector<double> gpu;
+  double drawCalls = 0;
+  double triangles = 0;
+  for (const auto& timing : timings)
+  {
+    cpu.push_back(timing.cpuMs);
+    if (timing.gpuMs >= 0)
+      gpu.push_back(timing.gpuMs);
+    drawCalls += timing.drawCalls;
+    triangles += double(timing.triangles);
+  }
+  std::ranges::sort(cpu);
+  std::ranges::sort(gpu);
+
+  const double frameCount = std::max<double>(1, double(timings.size()));
+  spdlog::info(
+    "{}: CPU p50/p95/p99 {:.3f}/{:.3f}/{:.3f} ms, GPU p50/p95/p99 {:.3f}/{:.3f}/{:.3f} ms,"
+    " {:.0f} draw calls and {:.0f} triangles per frame",
+    scene,
+    percentile(cpu, 50),
+    percentile(cpu, 95),
+    percentile(cpu, 99),
+    percentile(gpu, 50),
+    percentile(gpu, 95),
+    percentile(gpu, 99),
+    drawCalls / frameCount,
+    triangles / frameCount);
+}
+
+int main(int argc, char** argv)
+{
+  std::uint32_t framesInFlight = 2;
+  std::uint32_t frameCount = 0;
+  bool gpuCulling = false;
+  const char* replayPath = nullptr;
+  const char* csvDir = nullptr;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--frames-in-flight" && i + 1 < argc)
+      framesInFlight = static_cast<std::uint32_t>(std::clamp(std::atoi(argv[++i]), 1, 4));
+    else if (arg == "--frames" && i + 1 < argc)
+      frameCount = static_cast<std::uint32_t>(std::max(0, std::atoi(argv[++i])));
+    else if (arg == "--replay" && i + 1 < argc)
+      replayPath = argv[++i];
+    else if (arg == "--csv-dir" && i + 1 < argc)
+      csvDir = argv[++i];
+    else if (arg == "--gpu-culling")
+      gpuCulling = true;
+    else
+    {
+      spdlog::error(
+        "Unknown argument {}, usage: {} [--frames-in-flight <1-4>] [--frames <count>]"
+        " [--replay <path>] [--csv-dir <path>] [--gpu-culling]",
+        argv[i],
+        argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<FramePacket> cameraPath;
+  if (replayPath != nullptr)
+  {
+    cameraPath = read_frame_packets(replayPath);
+    if (cameraPath.empty())
+      return 1;
+  }
+  else if (frameCount == 0)
+    frameCount = 600;
+
+  std::vector<std::filesystem::path> sceneDirs;
+  for (const auto& entry :
+    std::filesystem::directory_iterator(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes"))
+    if (entry.is_directory())
+      sceneDirs.push_back(entry.path());
+  std::ranges::sort(sceneDirs);
+
+  {
+    // NOTE: draw calls and triangles are only counted exactly with CPU culling, the
+    // GPU path records a single indirect draw per view.
+    HeadlessApp app{HeadlessApp::CreateInfo{
+      .framesInFlight = framesInFlight,
+      .gpuCulling = gpuCulling,
+    }};
+
+    for (const auto& dir : sceneDirs)
+    {
+      const auto scenePath = find_scene_file(dir);
+      if (scenePath.empty())
+      {
+        spdlog::warn("No glTF files found in {}, skipping it", dir.string());
+        continue;
+      }
+
+      const auto timings = app.run(HeadlessApp::RunInfo{
+        .scenePath = scenePath,
+        .cameraPath = cameraPath,
+        .frameCount = frameCount,
+      });
+
+      const auto sceneName = dir.filename().string();
+      report(sceneName, timings);
+      if (csvDir != nullptr)
+        write_frame_timings(std::filesystem::path{csvDir} / (sceneName + ".csv"), timings);
+    }
+  }
+
+  if (etna::is_initilized())
+    etna::shutdown();
+
+  return 0;
+}
@@ -1,10 +1,62 @@
+#include <algorithm>
+#include <cstdlib>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
 #include "App.hpp"
+#include "FramePacketStream.hpp"
+#include "HeadlessApp.hpp"
 
 
-int main()
+int main(int argc, char** argv)
 {
+  std::uint32_t framesInFlight = 2;
+  // Zero means rendering into a window until it is closed
+  std::uint32_t headlessFrames = 0;
+  const char* csvPath = "shadowmap_timings.csv";
+  const char* replayPath = nullptr;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--frames-in-flight" && i + 1 < argc)
+      framesInFlight = static_cast<std::uint32_t>(std::clamp(std::atoi(argv[++i]), 1, 4));
+    else if (arg == "--headless" && i + 1 < argc)
+      headlessFrames = static_cast<std::uint32_t>(std::max(0, std::atoi(argv[++i])));
+    else if (arg == "--replay" && i + 1 < argc)
+      replayPath = argv[++i];
+    else if (arg == "--csv" && i + 1 < argc)
+      csvPath = argv[++i];
+    else
+      spdlog::warn(
+        "Unknown argument {}, usage: {} [--frames-in-flight <1-4>]"
+        " [--headless <frames> [--replay <path>] [--csv <path>]]",
+        argv[i],
+        argv[0]);
+  }
+
+  if (headlessFrames > 0 || replayPath != nullptr)
+  {
+    std::vector<FramePacket> cameraPath;
+    if (replayPath != nullptr)
+    {
+      cameraPath = read_frame_packets(replayPath);
+      if (cameraPath.empty())
+        return 1;
+    }
+
+    HeadlessApp app{HeadlessApp::CreateInfo{.framesInFlight = framesInFlight}};
+    const auto timings = app.run(HeadlessApp::RunInfo{
+      .scenePath = GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf",
+      .cameraPath = cameraPath,
+      .frameCount = headlessFrames,
+    });
+    if (write_frame_timings(csvPath, timings))
+      spdlog::info("Frame timings written to {}", csvPath);
+  }
+  else
   {
-    App app;
+    App app{framesInFlight};
     app.run();
   }
 
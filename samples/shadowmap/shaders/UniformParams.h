@@ -4,9 +4,15 @@
 #include "cpp_glsl_compat.h"
 
 
+// Directional light shadows are split into this many cascades, which are
+// stored as tiles of a single shadow map atlas with SHADOW_ATLAS_GRID tiles per side
+#define SHADOW_CASCADE_COUNT 4
+#define SHADOW_ATLAS_GRID 2
+
 struct UniformParams
 {
-  shader_mat4 lightMatrix;
+  // Light view-projection of every cascade, from the nearest one to the farthest one
+  shader_mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];
   shader_vec3 lightPos;
   shader_float time;
   shader_vec3 baseColor;
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth-only version of simple.vert for the shadow pass,
+// reads nothing but the position-only vertex stream.
+
+layout(location = 0) in vec3 vPos;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+} params;
+
+// Draws pass the index of the instance through firstInstance
+layout(std430, set = 0, binding = 2) readonly buffer InstanceMatrices
+{
+  mat4 instanceMatrices[];
+};
+
+out gl_PerVertex { vec4 gl_Position; };
+void main(void)
+{
+  gl_Position = params.mProjView * (instanceMatrices[gl_InstanceIndex] * vec4(vPos, 1.0f));
+}
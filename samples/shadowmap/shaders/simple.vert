@@ -4,16 +4,40 @@
 
 #include "unpack_attributes.glsl"
 
+// Baked scenes use BakedVertex from scene/BakedSceneFormat.hpp,
+// normals and tangents are unpacked from snorm8 by the hardware
+#ifndef BAKED_VERTEX
+#define BAKED_VERTEX 0
+#endif
 
+
+#if BAKED_VERTEX
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec4 vNorm;
+layout(location = 2) in vec2 vTexCoord;
+layout(location = 3) in vec4 vTang;
+#else
 layout(location = 0) in vec4 vPosNorm;
 layout(location = 1) in vec4 vTexCoordAndTang;
+#endif
 
 layout(push_constant) uniform params_t
 {
   mat4 mProjView;
-  mat4 mModel;
 } params;
 
+// Draws pass the index of the instance through firstInstance
+layout(std430, set = 0, binding = 2) readonly buffer InstanceMatrices
+{
+  mat4 instanceMatrices[];
+};
+
+// Inverse transposed model matrices, up to a scale, computed once on the CPU
+layout(std430, set = 0, binding = 3) readonly buffer InstanceNormalMatrices
+{
+  mat3x4 instanceNormalMatrices[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -26,13 +50,25 @@ layout (location = 0 ) out VS_OUT
 out gl_PerVertex { vec4 gl_Position; };
 void main(void)
 {
+#if BAKED_VERTEX
+  const vec3 pos = vPos;
+  const vec4 wNorm = vec4(vNorm.xyz, 0.0f);
+  const vec4 wTang = vec4(vTang.xyz, 0.0f);
+  const vec2 texCoord = vTexCoord;
+#else
+  const vec3 pos = vPosNorm.xyz;
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
   const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
+  const vec2 texCoord = vTexCoordAndTang.xy;
+#endif
+
+  const mat4 mModel = instanceMatrices[gl_InstanceIndex];
+  const mat3 mNormal = mat3(instanceNormalMatrices[gl_InstanceIndex]);
 
-  vOut.wPos = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
-  vOut.texCoord = vTexCoordAndTang.xy;
+  vOut.wPos = (mModel * vec4(pos, 1.0f)).xyz;
+  vOut.wNorm = normalize(mNormal * wNorm.xyz);
+  vOut.wTangent = normalize(mNormal * wTang.xyz);
+  vOut.texCoord = texCoord;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
 }
@@ -22,28 +22,78 @@ layout(binding = 0, set = 0) uniform AppData
 
 layout(binding = 1) uniform sampler2D shadowMap;
 
-void main()
+// PCF, ANIMATED_LIGHT and SHOW_CASCADES are set to 0 or 1 by CMake for every
+// variant of this shader, see MaterialPermutation.hpp
+
+// Cascades cover nested regions, so the first one that contains the point is
+// the one with the best resolution. Returns -1 for points outside of all cascades.
+int find_cascade(vec3 wPos, out vec3 shadowCoord)
 {
-  const vec4 posLightClipSpace = params.lightMatrix*vec4(surf.wPos, 1.0f);
+  for (int i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    const vec4 posLightClipSpace = params.cascadeMatrices[i] * vec4(wPos, 1.0f);
+    const vec3 posLightSpaceNDC = posLightClipSpace.xyz / posLightClipSpace.w;
+
+    // just shift coords from [-1,1] to [0,1]
+    const vec2 cascadeTexCoord = posLightSpaceNDC.xy * 0.5f + vec2(0.5f, 0.5f);
 
-  // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
-  const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+    // The margin keeps filtering from reading the neighbouring tiles of the atlas
+    const bool outOfView = any(lessThan(cascadeTexCoord, vec2(0.001f)))
+      || any(greaterThan(cascadeTexCoord, vec2(0.999f))) || posLightSpaceNDC.z > 1.0f;
+    if (outOfView)
+      continue;
 
-  // just shift coords from [-1,1] to [0,1]
-  const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
+    const vec2 tile = vec2(i % SHADOW_ATLAS_GRID, i / SHADOW_ATLAS_GRID);
+    shadowCoord = vec3((cascadeTexCoord + tile) / SHADOW_ATLAS_GRID, posLightSpaceNDC.z);
+    return i;
+  }
 
-  const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+  return -1;
+}
 
+float sample_shadow(vec3 shadowCoord)
+{
+#if PCF
+  // 3x3 taps, the atlas margin is wider than a texel for every cascade
+  const vec2 texelSize = 1.0f / vec2(textureSize(shadowMap, 0));
+  float lit = 0.0f;
+  for (int y = -1; y <= 1; ++y)
+    for (int x = -1; x <= 1; ++x)
+    {
+      const float depth = textureLod(shadowMap, shadowCoord.xy + vec2(x, y) * texelSize, 0).x;
+      lit += shadowCoord.z < depth + 0.001f ? 1.0f : 0.0f;
+    }
+  return lit / 9.0f;
+#else
+  return shadowCoord.z < textureLod(shadowMap, shadowCoord.xy, 0).x + 0.001f ? 1.0f : 0.0f;
+#endif
+}
+
+void main()
+{
+  vec3 shadowCoord;
+  const int cascade = find_cascade(surf.wPos, shadowCoord);
+  const float shadow = cascade < 0 ? 1.0f : sample_shadow(shadowCoord);
+
+#if ANIMATED_LIGHT
   const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
   const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
 
   const vec4 lightColor1 = mix(dark_violet, chartreuse, abs(sin(params.time)));
-  const vec4 lightColor2 = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+#else
+  const vec4 lightColor1 = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+#endif
 
   const vec3 lightDir   = normalize(params.lightPos - surf.wPos);
   const vec4 lightColor = max(dot(surf.wNorm, lightDir), 0.0f) * lightColor1;
   const float ambient = 0.05;
   // Light formula is pretty arbitrary and most definitely wrong
   out_fragColor = (lightColor * shadow + ambient) * vec4(params.baseColor, 1.0f);
+
+#if SHOW_CASCADES
+  const vec3 cascadeColors[4] = vec3[](
+    vec3(1.0f, 0.2f, 0.2f), vec3(0.2f, 1.0f, 0.2f), vec3(0.2f, 0.2f, 1.0f), vec3(1.0f, 1.0f, 0.2f));
+  if (cascade >= 0)
+    out_fragColor.rgb = mix(out_fragColor.rgb, cascadeColors[cascade % 4], 0.5f);
+#endif
 }
@@ -0,0 +1,576 @@
+#include "Baker.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include "scene/BakedSceneFormat.hpp"
+#include "scene/GltfInstances.hpp"
+
+#include "MeshOptimizer.hpp"
+
+
+namespace
+{
+
+constexpr const char* QUANTIZATION_EXTENSION = "KHR_mesh_quantization";
+
+// Buffer views of the baked model, there are always exactly two of them
+constexpr int VERTEX_BUFFER_VIEW = 0;
+constexpr int INDEX_BUFFER_VIEW = 1;
+
+std::optional<tinygltf::Model> load_model(const std::filesystem::path& path)
+{
+  tinygltf::TinyGLTF loader;
+  tinygltf::Model model;
+
+  std::string error;
+  std::string warning;
+  bool success = false;
+
+  const auto ext = path.extension();
+  if (ext == ".gltf")
+    success = loader.LoadASCIIFromFile(&model, &error, &warning, path.string());
+  else if (ext == ".glb")
+    success = loader.LoadBinaryFromFile(&model, &error, &warning, path.string());
+  else
+  {
+    std::cerr << "Unknown glTF file extension: '" << ext.string() << "'. Expected .gltf or .glb.\n";
+    return std::nullopt;
+  }
+
+  if (!warning.empty())
+    std::cerr << "glTF warning: " << warning << "\n";
+
+  if (!success)
+  {
+    std::cerr << "Failed to load '" << path.string() << "': " << error << "\n";
+    return std::nullopt;
+  }
+
+  return model;
+}
+
+float read_component(const unsigned char* src, int component_type, bool normalized)
+{
+  const auto read = [src]<class T>(T) {
+    T value;
+    std::memcpy(&value, src, sizeof(T));
+    return value;
+  };
+
+  // See the KHR_mesh_quantization spec for the normalized conversion rules
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return read(float{});
+  case TINYGLTF_COMPONENT_TYPE_BYTE: {
+    const float value = read(std::int8_t{});
+    return normalized ? std::max(value / 127.0f, -1.0f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+    const float value = read(std::uint8_t{});
+    return normalized ? value / 255.0f : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_SHORT: {
+    const float value = read(std::int16_t{});
+    return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+    const float value = read(std::uint16_t{});
+    return normalized ? value / 65535.0f : value;
+  }
+  default:
+    return 0.0f;
+  }
+}
+
+// Random access to the elements of an accessor. Absent accessors read as zeroes.
+// Way slower than the decoders in SceneManager, but we are offline, so who cares.
+class AccessorReader
+{
+public:
+  AccessorReader() = default;
+
+  AccessorReader(const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+    : componentType{accessor.componentType}
+    , componentSize{tinygltf::GetComponentSizeInBytes(accessor.componentType)}
+    , componentCount{tinygltf::GetNumComponentsInType(accessor.type)}
+    , normalized{accessor.normalized}
+  {
+    const auto& view = model.bufferViews[accessor.bufferView];
+    data = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+    stride = view.byteStride != 0 ? view.byteStride : componentSize * componentCount;
+  }
+
+  explicit operator bool() const { return data != nullptr; }
+
+  glm::vec4 vec(std::size_t idx) const
+  {
+    glm::vec4 result{0.0f};
+    if (data == nullptr)
+      return result;
+    const unsigned char* src = data + idx * stride;
+    for (int i = 0; i < std::min(componentCount, 4); ++i)
+      result[i] = read_component(src + i * componentSize, componentType, normalized);
+    return result;
+  }
+
+  std::uint32_t index(std::size_t idx) const
+  {
+    const unsigned char* src = data + idx * stride;
+    switch (componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return *src;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+      std::uint16_t value;
+      std::memcpy(&value, src, sizeof(value));
+      return value;
+    }
+    default: {
+      std::uint32_t value;
+      std::memcpy(&value, src, sizeof(value));
+      return value;
+    }
+    }
+  }
+
+private:
+  const unsigned char* data = nullptr;
+  std::size_t stride = 0;
+  int componentType = 0;
+  int componentSize = 0;
+  int componentCount = 0;
+  bool normalized = false;
+};
+
+std::int8_t quantize_snorm8(float value)
+{
+  return static_cast<std::int8_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+// The 4th component is the handedness of a glTF tangent basis, it is +-1 by the spec
+void quantize_direction(glm::vec4 dir_and_sign, std::int8_t (&out)[4])
+{
+  glm::vec3 dir{dir_and_sign};
+  const float len = glm::length(dir);
+  if (len > 1e-9f)
+    dir /= len;
+  out[0] = quantize_snorm8(dir.x);
+  out[1] = quantize_snorm8(dir.y);
+  out[2] = quantize_snorm8(dir.z);
+  // NOTE: absent tangents read as zeroes, treat them as right-handed
+  out[3] = dir_and_sign.w < 0.0f ? -127 : 127;
+}
+
+struct BakedMeshes
+{
+  std::vector<BakedVertex> vertices;
+  std::vector<std::uint32_t> indices;
+  std::vector<BakedRenderElement> relems;
+  std::vector<BakedRenderElementLod> lods;
+  std::vector<BakedRenderElementBounds> bounds;
+  std::vector<BakedMesh> meshes;
+};
+
+int add_accessor(
+  tinygltf::Model& model,
+  int buffer_view,
+  std::size_t byte_offset,
+  int component_type,
+  int type,
+  std::size_t count,
+  bool normalized = false)
+{
+  tinygltf::Accessor accessor;
+  accessor.bufferView = buffer_view;
+  accessor.byteOffset = byte_offset;
+  accessor.componentType = component_type;
+  accessor.type = type;
+  accessor.count = count;
+  accessor.normalized = normalized;
+  model.accessors.push_back(std::move(accessor));
+  return static_cast<int>(model.accessors.size() - 1);
+}
+
+struct BakeStats
+{
+  VertexCacheStats before;
+  VertexCacheStats after;
+  // Indices of all LODs except for LOD 0
+  std::size_t lodIndices = 0;
+};
+
+// Converts all triangle primitives of `src` into BakedVertex-es and uint32 indices,
+// and fills `dst` meshes with primitives describing the result.
+BakedMeshes bake_meshes(
+  const tinygltf::Model& src, tinygltf::Model& dst, const BakeOptions& options, BakeStats& stats)
+{
+  BakedMeshes result;
+
+  dst.accessors.clear();
+  dst.meshes.clear();
+  dst.meshes.reserve(src.meshes.size());
+  result.meshes.reserve(src.meshes.size());
+
+  for (const auto& srcMesh : src.meshes)
+  {
+    auto& dstMesh = dst.meshes.emplace_back();
+    dstMesh.name = srcMesh.name;
+
+    result.meshes.push_back(BakedMesh{
+      .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
+      .relemCount = 0,
+    });
+
+    for (const auto& prim : srcMesh.primitives)
+    {
+      if (prim.mode != TINYGLTF_MODE_TRIANGLES || prim.indices < 0)
+      {
+        std::cerr << "Mesh '" << srcMesh.name
+                  << "' has a non-indexed or non-triangles primitive, skipping it!\n";
+        continue;
+      }
+
+      const auto reader = [&](const char* name) {
+        const auto it = prim.attributes.find(name);
+        return it != prim.attributes.end() ? AccessorReader(src, src.accessors[it->second])
+                                           : AccessorReader{};
+      };
+
+      const auto& positionAccessor = src.accessors[prim.attributes.at("POSITION")];
+      const auto& indexAccessor = src.accessors[prim.indices];
+
+      const AccessorReader position{src, positionAccessor};
+      const AccessorReader normal = reader("NORMAL");
+      const AccessorReader tangent = reader("TANGENT");
+      const AccessorReader texcoord = reader("TEXCOORD_0");
+      const AccessorReader indices{src, indexAccessor};
+
+      std::vector<BakedVertex> vertices(positionAccessor.count);
+      for (std::size_t i = 0; i < vertices.size(); ++i)
+      {
+        BakedVertex& vertex = vertices[i];
+        vertex.position = glm::vec3(position.vec(i));
+        vertex.texcoord = glm::vec2(texcoord.vec(i));
+        quantize_direction(normal.vec(i), vertex.normal);
+        quantize_direction(tangent.vec(i), vertex.tangent);
+        // NOTE: the 4th normal byte is padding, keep it zero
+        vertex.normal[3] = 0;
+      }
+
+      std::vector<std::uint32_t> primIndices(indexAccessor.count);
+      for (std::size_t i = 0; i < primIndices.size(); ++i)
+        primIndices[i] = indices.index(i);
+
+      const auto positions = [&vertices]() {
+        std::vector<glm::vec3> result(vertices.size());
+        for (std::size_t i = 0; i < vertices.size(); ++i)
+          result[i] = vertices[i].position;
+        return result;
+      };
+
+      stats.before += analyze_vertex_cache(primIndices, vertices.size());
+      if (options.optimizeVertexCache)
+        optimize_vertex_cache(primIndices, vertices.size());
+      if (options.optimizeOverdraw)
+        optimize_overdraw(primIndices, positions(), options.overdrawThreshold);
+      // NOTE: this also drops vertices which are not referenced by any triangle
+      if (options.optimizeVertexFetch)
+        optimize_vertex_fetch(std::span{primIndices}, vertices);
+      stats.after += analyze_vertex_cache(primIndices, vertices.size());
+
+      // Every LOD has about half the triangles of the previous one and is simplified
+      // from LOD 0, so that errors don't accumulate. LODs are only stored while they
+      // are noticeably smaller than the previous one.
+      std::vector<SimplifyResult> lods;
+      if (options.maxLodCount > 1)
+      {
+        const auto lodPositions = positions();
+        std::vector<glm::vec3> lodNormals(vertices.size());
+        for (std::size_t i = 0; i < vertices.size(); ++i)
+        {
+          const auto& n = vertices[i].normal;
+          lodNormals[i] = glm::vec3(n[0], n[1], n[2]) / 127.0f;
+        }
+
+        std::size_t prevIndexCount = primIndices.size();
+        for (std::uint32_t lod = 1; lod < options.maxLodCount; ++lod)
+        {
+          const std::size_t target = (primIndices.size() >> lod) / 3 * 3;
+          auto simplified = simplify(primIndices, lodPositions, lodNormals, target);
+          if (simplified.indices.empty() || simplified.indices.size() * 5 > prevIndexCount * 4)
+            break;
+
+          if (options.optimizeVertexCache)
+            optimize_vertex_cache(simplified.indices, vertices.size());
+          prevIndexCount = simplified.indices.size();
+          lods.push_back(std::move(simplified));
+        }
+      }
+
+      glm::vec3 minPos{std::numeric_limits<float>::max()};
+      glm::vec3 maxPos{std::numeric_limits<float>::lowest()};
+      for (const auto& vertex : vertices)
+      {
+        minPos = glm::min(minPos, vertex.position);
+        maxPos = glm::max(maxPos, vertex.position);
+      }
+
+      BakedRenderElementBounds bounds{
+        .aabbMin = minPos,
+        .aabbMax = maxPos,
+        .sphereCenter = (minPos + maxPos) * 0.5f,
+        .sphereRadius = 0,
+      };
+      for (const auto& vertex : vertices)
+        bounds.sphereRadius =
+          std::max(bounds.sphereRadius, glm::distance(bounds.sphereCenter, vertex.position));
+      result.bounds.push_back(bounds);
+
+      const BakedRenderElement relem{
+        .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
+        .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
+        .indexCount = static_cast<std::uint32_t>(primIndices.size()),
+        .firstLod = static_cast<std::uint32_t>(result.lods.size()),
+        .lodCount = static_cast<std::uint32_t>(lods.size() + 1),
+      };
+      const std::size_t vertexCount = vertices.size();
+
+      result.vertices.insert(result.vertices.end(), vertices.begin(), vertices.end());
+
+      const auto appendLod = [&result](std::span<const std::uint32_t> lod_indices, float error) {
+        result.lods.push_back(BakedRenderElementLod{
+          .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
+          .indexCount = static_cast<std::uint32_t>(lod_indices.size()),
+          .error = error,
+        });
+        result.indices.insert(result.indices.end(), lod_indices.begin(), lod_indices.end());
+      };
+
+      appendLod(primIndices, 0.0f);
+      for (const auto& lod : lods)
+      {
+        appendLod(lod.indices, lod.error);
+        stats.lodIndices += lod.indices.size();
+      }
+
+      result.relems.push_back(relem);
+      ++result.meshes.back().relemCount;
+
+      // Describe the baked data for the debug glTF
+      const std::size_t vertexByteOffset = relem.vertexOffset * sizeof(BakedVertex);
+
+      tinygltf::Primitive dstPrim;
+      dstPrim.mode = TINYGLTF_MODE_TRIANGLES;
+      dstPrim.material = prim.material;
+      dstPrim.indices = add_accessor(
+        dst,
+        INDEX_BUFFER_VIEW,
+        relem.indexOffset * sizeof(std::uint32_t),
+        TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+        TINYGLTF_TYPE_SCALAR,
+        relem.indexCount);
+
+      const int positionIdx = add_accessor(
+        dst,
+        VERTEX_BUFFER_VIEW,
+        vertexByteOffset + offsetof(BakedVertex, position),
+        TINYGLTF_COMPONENT_TYPE_FLOAT,
+        TINYGLTF_TYPE_VEC3,
+        vertexCount);
+      // glTF requires bounds for positions
+      dst.accessors[positionIdx].minValues = {minPos.x, minPos.y, minPos.z};
+      dst.accessors[positionIdx].maxValues = {maxPos.x, maxPos.y, maxPos.z};
+      dstPrim.attributes["POSITION"] = positionIdx;
+
+      // Absent attributes are baked as zeroes, but zero normals and tangents
+      // are not valid glTF, so they are only described if the source had them.
+      if (normal)
+        dstPrim.attributes["NORMAL"] = add_accessor(
+          dst,
+          VERTEX_BUFFER_VIEW,
+          vertexByteOffset + offsetof(BakedVertex, normal),
+          TINYGLTF_COMPONENT_TYPE_BYTE,
+          TINYGLTF_TYPE_VEC3,
+          vertexCount,
+          true);
+      if (texcoord)
+        dstPrim.attributes["TEXCOORD_0"] = add_accessor(
+          dst,
+          VERTEX_BUFFER_VIEW,
+          vertexByteOffset + offsetof(BakedVertex, texcoord),
+          TINYGLTF_COMPONENT_TYPE_FLOAT,
+          TINYGLTF_TYPE_VEC2,
+          vertexCount);
+      if (tangent)
+        dstPrim.attributes["TANGENT"] = add_accessor(
+          dst,
+          VERTEX_BUFFER_VIEW,
+          vertexByteOffset + offsetof(BakedVertex, tangent),
+          TINYGLTF_COMPONENT_TYPE_BYTE,
+          TINYGLTF_TYPE_VEC4,
+          vertexCount,
+          true);
+
+      dstMesh.primitives.push_back(std::move(dstPrim));
+    }
+  }
+
+  return result;
+}
+
+template <class T>
+void write_array(std::ofstream& out, const std::vector<T>& data)
+{
+  out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+}
+
+} // namespace
+
+bool bake_scene(const std::filesystem::path& path, const BakeOptions& options)
+{
+  auto maybeModel = load_model(path);
+  if (!maybeModel.has_value())
+    return false;
+
+  const tinygltf::Model src = std::move(*maybeModel);
+
+  if (src.scenes.empty())
+  {
+    std::cerr << "'" << path.string() << "' contains no scenes!\n";
+    return false;
+  }
+
+  for (const auto& image : src.images)
+    if (image.bufferView >= 0)
+    {
+      std::cerr << "Images embedded into glTF buffers are not supported!\n";
+      return false;
+    }
+
+  const auto outPath = [&path](const char* ext) {
+    return path.parent_path() / (path.stem().string() + "_baked" + ext);
+  };
+  const auto gltfPath = outPath(".gltf");
+  const auto binPath = outPath(".bin");
+  const auto metaPath = outPath(".meta");
+
+  // Everything except for the geometry is kept as is
+  tinygltf::Model dst = src;
+
+  if (!dst.animations.empty() || !dst.skins.empty())
+  {
+    std::cerr << "Animations and skins are not supported, dropping them!\n";
+    dst.animations.clear();
+    dst.skins.clear();
+    for (auto& node : dst.nodes)
+      node.skin = -1;
+  }
+
+  BakeStats stats;
+  BakedMeshes baked = bake_meshes(src, dst, options, stats);
+
+  const std::size_t vertexBytes = baked.vertices.size() * sizeof(BakedVertex);
+  const std::size_t indexBytes = baked.indices.size() * sizeof(std::uint32_t);
+
+  {
+    tinygltf::Buffer buffer;
+    buffer.uri = binPath.filename().string();
+    buffer.data.resize(vertexBytes + indexBytes);
+    std::memcpy(buffer.data.data(), baked.vertices.data(), vertexBytes);
+    std::memcpy(buffer.data.data() + vertexBytes, baked.indices.data(), indexBytes);
+    dst.buffers = {std::move(buffer)};
+  }
+
+  {
+    tinygltf::BufferView vertexView;
+    vertexView.buffer = 0;
+    vertexView.byteOffset = 0;
+    vertexView.byteLength = vertexBytes;
+    vertexView.byteStride = sizeof(BakedVertex);
+    vertexView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+
+    tinygltf::BufferView indexView;
+    indexView.buffer = 0;
+    indexView.byteOffset = vertexBytes;
+    indexView.byteLength = indexBytes;
+    indexView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+
+    dst.bufferViews = {std::move(vertexView), std::move(indexView)};
+    static_assert(VERTEX_BUFFER_VIEW == 0 && INDEX_BUFFER_VIEW == 1);
+  }
+
+  for (auto* extensions : {&dst.extensionsUsed, &dst.extensionsRequired})
+    if (std::find(extensions->begin(), extensions->end(), QUANTIZATION_EXTENSION) ==
+        extensions->end())
+      extensions->push_back(QUANTIZATION_EXTENSION);
+
+  // Without decoded pixels tinygltf keeps the original image URIs
+  // instead of re-encoding the images next to the baked model.
+  for (auto& image : dst.images)
+    image.image.clear();
+
+  // NOTE: the .bin file is written by tinygltf
+  tinygltf::TinyGLTF writer;
+  if (!writer.WriteGltfSceneToFile(&dst, gltfPath.string(), false, false, true, false))
+  {
+    std::cerr << "Failed to write '" << gltfPath.string() << "'!\n";
+    return false;
+  }
+
+  const auto [instanceMatrices, instanceMeshes] = process_instances(src);
+
+  const BakedSceneHeader header{
+    .magic = BAKED_SCENE_MAGIC,
+    .version = BAKED_SCENE_VERSION,
+    .vertexCount = static_cast<std::uint32_t>(baked.vertices.size()),
+    .indexCount = static_cast<std::uint32_t>(baked.indices.size()),
+    .relemCount = static_cast<std::uint32_t>(baked.relems.size()),
+    .meshCount = static_cast<std::uint32_t>(baked.meshes.size()),
+    .instanceCount = static_cast<std::uint32_t>(instanceMatrices.size()),
+    .lodCount = static_cast<std::uint32_t>(baked.lods.size()),
+    .vertexByteOffset = 0,
+    .indexByteOffset = vertexBytes,
+  };
+
+  {
+    std::ofstream meta(metaPath, std::ios::binary);
+    meta.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_array(meta, baked.relems);
+    write_array(meta, baked.lods);
+    write_array(meta, baked.bounds);
+    write_array(meta, baked.meshes);
+    write_array(meta, instanceMatrices);
+    write_array(meta, instanceMeshes);
+    if (!meta)
+    {
+      std::cerr << "Failed to write '" << metaPath.string() << "'!\n";
+      return false;
+    }
+  }
+
+  std::cout << "Baked '" << path.string() << "': " << baked.vertices.size() << " vertices, "
+            << baked.indices.size() << " indices, " << baked.relems.size() << " relems, "
+            << instanceMatrices.size() << " instances\n";
+
+  std::cout << std::fixed << std::setprecision(3) << "Vertex cache: ACMR "
+            << stats.before.acmr() << " -> " << stats.after.acmr() << ", ATVR "
+            << stats.before.atvr() << " -> " << stats.after.atvr() << "\n";
+
+  std::cout << "LODs: " << baked.lods.size() - baked.relems.size() << " for "
+            << baked.relems.size() << " relems, " << stats.lodIndices << " extra indices\n";
+
+  return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+
+
+struct BakeOptions
+{
+  // Reorder triangles for post-transform vertex cache hits
+  bool optimizeVertexCache = true;
+  // Reorder vertices in the order they are fetched in by the index buffer
+  bool optimizeVertexFetch = true;
+  // Sort clusters of triangles to reduce overdraw, at the cost of some cache hits
+  bool optimizeOverdraw = false;
+  // How much worse ACMR may get due to overdraw optimization
+  float overdrawThreshold = 1.05f;
+  // Relems get up to this many LODs including the original one, 1 disables simplification
+  std::uint32_t maxLodCount = 4;
+};
+
+// Bakes `path` (a .gltf or .glb file) into `<name>_baked.gltf`, `<name>_baked.bin`
+// and `<name>_baked.meta` next to it, see scene/BakedSceneFormat.hpp for details.
+// Returns false and reports the reason to stderr on failure.
+bool bake_scene(const std::filesystem::path& path, const BakeOptions& options);
@@ -0,0 +1,621 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other)
+{
+  triangles += other.triangles;
+  vertices += other.vertices;
+  transformed += other.transformed;
+  return *this;
+}
+
+VertexCacheStats analyze_vertex_cache(
+  std::span<const std::uint32_t> indices, std::size_t vertex_count, std::uint32_t cache_size)
+{
+  VertexCacheStats result{.triangles = indices.size() / 3};
+
+  // A vertex is in a FIFO cache iff it was one of the last `cache_size` vertices put into it
+  std::vector<std::uint64_t> insertedAt(vertex_count, 0);
+  std::vector<bool> used(vertex_count, false);
+  std::uint64_t time = cache_size + 1;
+
+  for (const std::uint32_t idx : indices)
+  {
+    if (time - insertedAt[idx] > cache_size)
+    {
+      insertedAt[idx] = time++;
+      ++result.transformed;
+    }
+    if (!used[idx])
+    {
+      used[idx] = true;
+      ++result.vertices;
+    }
+  }
+
+  return result;
+}
+
+namespace
+{
+
+// Constants from the original article
+constexpr std::size_t FORSYTH_CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRI_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+float vertex_score(int cache_pos, std::uint32_t remaining_triangles)
+{
+  if (remaining_triangles == 0)
+    return -1.0f;
+
+  float score = 0.0f;
+  if (cache_pos >= 0)
+  {
+    // Vertices of the last triangle get a fixed score, so that
+    // we don't end up creating strips and wasting the rest of the cache
+    if (cache_pos < 3)
+      score = LAST_TRI_SCORE;
+    else
+    {
+      const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = std::pow(1.0f - static_cast<float>(cache_pos - 3) * scaler, CACHE_DECAY_POWER);
+    }
+  }
+
+  // Vertices with few triangles left are boosted, so that we get rid of them quickly
+  return score +
+    VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangles), -VALENCE_BOOST_POWER);
+}
+
+} // namespace
+
+void optimize_vertex_cache(std::span<std::uint32_t> indices, std::size_t vertex_count)
+{
+  // NOTE: a trailing incomplete triangle is left where it is
+  indices = indices.first(indices.size() - indices.size() % 3);
+
+  const std::size_t triCount = indices.size() / 3;
+  if (triCount < 2)
+    return;
+
+  // Triangles adjacent to every vertex, the first `remaining[v]` ones
+  // starting from adjOffsets[v] are the ones that are not emitted yet.
+  std::vector<std::uint32_t> remaining(vertex_count, 0);
+  for (const std::uint32_t idx : indices)
+    ++remaining[idx];
+
+  std::vector<std::uint32_t> adjOffsets(vertex_count + 1, 0);
+  for (std::size_t v = 0; v < vertex_count; ++v)
+    adjOffsets[v + 1] = adjOffsets[v] + remaining[v];
+
+  std::vector<std::uint32_t> adjacency(indices.size());
+  {
+    std::vector<std::uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); ++i)
+      adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+  }
+
+  std::vector<int> cachePos(vertex_count, -1);
+  std::vector<float> vertexScores(vertex_count);
+  for (std::size_t v = 0; v < vertex_count; ++v)
+    vertexScores[v] = vertex_score(-1, remaining[v]);
+
+  std::vector<float> triScores(triCount);
+  for (std::size_t t = 0; t < triCount; ++t)
+    triScores[t] = vertexScores[indices[3 * t + 0]] + vertexScores[indices[3 * t + 1]] +
+      vertexScores[indices[3 * t + 2]];
+
+  std::vector<bool> emitted(triCount, false);
+  std::vector<std::uint32_t> result;
+  result.reserve(indices.size());
+
+  std::vector<std::uint32_t> cache;
+  std::vector<std::uint32_t> newCache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+  auto bestTri = static_cast<std::size_t>(
+    std::max_element(triScores.begin(), triScores.end()) - triScores.begin());
+  std::size_t nextUnemitted = 0;
+
+  while (result.size() < indices.size())
+  {
+    const std::uint32_t tri[3] = {
+      indices[3 * bestTri + 0], indices[3 * bestTri + 1], indices[3 * bestTri + 2]};
+
+    emitted[bestTri] = true;
+    result.insert(result.end(), std::begin(tri), std::end(tri));
+
+    // Vertices of the new triangle go to the front of the LRU cache
+    newCache.clear();
+    for (const std::uint32_t v : tri)
+      if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+        newCache.push_back(v);
+    for (const std::uint32_t v : cache)
+      if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+        newCache.push_back(v);
+
+    for (const std::uint32_t v : tri)
+    {
+      const auto first = adjacency.begin() + adjOffsets[v];
+      const auto last = first + remaining[v];
+      std::iter_swap(std::find(first, last, static_cast<std::uint32_t>(bestTri)), last - 1);
+      --remaining[v];
+    }
+
+    // Rescore everything that was in the cache, including the evicted vertices
+    for (std::size_t i = 0; i < newCache.size(); ++i)
+    {
+      const std::uint32_t v = newCache[i];
+      cachePos[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+
+      const float score = vertex_score(cachePos[v], remaining[v]);
+      const float delta = score - vertexScores[v];
+      vertexScores[v] = score;
+
+      for (std::uint32_t j = 0; j < remaining[v]; ++j)
+        triScores[adjacency[adjOffsets[v] + j]] += delta;
+    }
+
+    newCache.resize(std::min(newCache.size(), FORSYTH_CACHE_SIZE));
+    std::swap(cache, newCache);
+
+    // Only triangles touching the cache may have changed, so the best one is among them
+    float bestScore = -std::numeric_limits<float>::infinity();
+    bool found = false;
+    for (const std::uint32_t v : cache)
+      for (std::uint32_t j = 0; j < remaining[v]; ++j)
+      {
+        const std::uint32_t t = adjacency[adjOffsets[v] + j];
+        if (triScores[t] > bestScore)
+        {
+          bestScore = triScores[t];
+          bestTri = t;
+          found = true;
+        }
+      }
+
+    // Nothing adjacent to the cache is left, so just take any remaining triangle
+    if (!found && result.size() < indices.size())
+    {
+      while (emitted[nextUnemitted])
+        ++nextUnemitted;
+      bestTri = nextUnemitted;
+    }
+  }
+
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimize_overdraw(
+  std::span<std::uint32_t> indices, std::span<const glm::vec3> positions, float threshold)
+{
+  const std::size_t triCount = indices.size() / 3;
+  if (triCount < 2)
+    return;
+
+  const VertexCacheStats before = analyze_vertex_cache(indices, positions.size());
+
+  // Split the triangles into clusters at the points where the cache gets
+  // completely flushed, reordering such clusters costs very little.
+  std::vector<std::size_t> clusterStarts{0};
+  {
+    std::vector<std::uint64_t> insertedAt(positions.size(), 0);
+    constexpr std::uint64_t CACHE_SIZE = 16;
+    std::uint64_t time = CACHE_SIZE + 1;
+    for (std::size_t t = 0; t < triCount; ++t)
+    {
+      int misses = 0;
+      for (int k = 0; k < 3; ++k)
+      {
+        const std::uint32_t idx = indices[3 * t + k];
+        if (time - insertedAt[idx] > CACHE_SIZE)
+        {
+          insertedAt[idx] = time++;
+          ++misses;
+        }
+      }
+      if (misses == 3 && t != 0)
+        clusterStarts.push_back(t);
+    }
+  }
+  clusterStarts.push_back(triCount);
+
+  const std::size_t clusterCount = clusterStarts.size() - 1;
+  if (clusterCount < 2)
+    return;
+
+  struct Cluster
+  {
+    std::size_t first;
+    std::size_t last;
+    float sortKey;
+  };
+
+  // Area-weighted centroids and normals
+  glm::vec3 meshCentroid{0.0f};
+  float meshArea = 0.0f;
+  std::vector<Cluster> clusters(clusterCount);
+  std::vector<glm::vec3> clusterCentroids(clusterCount);
+  std::vector<glm::vec3> clusterNormals(clusterCount);
+
+  for (std::size_t c = 0; c < clusterCount; ++c)
+  {
+    glm::vec3 centroid{0.0f};
+    glm::vec3 normal{0.0f};
+    float area = 0.0f;
+    for (std::size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+    {
+      const glm::vec3& a = positions[indices[3 * t + 0]];
+      const glm::vec3& b = positions[indices[3 * t + 1]];
+      const glm::vec3& d = positions[indices[3 * t + 2]];
+      const glm::vec3 n = glm::cross(b - a, d - a);
+      const float triArea = glm::length(n);
+      centroid += (a + b + d) * (triArea / 3.0f);
+      normal += n;
+      area += triArea;
+    }
+
+    meshCentroid += centroid;
+    meshArea += area;
+
+    clusters[c] = Cluster{.first = clusterStarts[c], .last = clusterStarts[c + 1], .sortKey = 0};
+    clusterCentroids[c] = area > 0 ? centroid / area : centroid;
+    clusterNormals[c] = normal;
+  }
+
+  if (meshArea > 0)
+    meshCentroid /= meshArea;
+
+  // Clusters which face away from the center are likely to occlude others
+  for (std::size_t c = 0; c < clusterCount; ++c)
+  {
+    const float len = glm::length(clusterNormals[c]);
+    clusters[c].sortKey =
+      len > 0 ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / len) : 0.0f;
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+    return a.sortKey > b.sortKey;
+  });
+
+  std::vector<std::uint32_t> reordered;
+  reordered.reserve(indices.size());
+  for (const auto& cluster : clusters)
+    reordered.insert(
+      reordered.end(), indices.begin() + 3 * cluster.first, indices.begin() + 3 * cluster.last);
+
+  const VertexCacheStats after = analyze_vertex_cache(reordered, positions.size());
+  if (after.acmr() <= before.acmr() * threshold)
+    std::copy(reordered.begin(), reordered.end(), indices.begin());
+}
+
+std::vector<std::uint32_t> optimize_vertex_fetch_remap(
+  std::span<std::uint32_t> indices, std::size_t vertex_count)
+{
+  constexpr std::uint32_t UNUSED = std::numeric_limits<std::uint32_t>::max();
+
+  std::vector<std::uint32_t> newIndices(vertex_count, UNUSED);
+  std::vector<std::uint32_t> remap;
+  remap.reserve(vertex_count);
+
+  for (std::uint32_t& idx : indices)
+  {
+    if (newIndices[idx] == UNUSED)
+    {
+      newIndices[idx] = static_cast<std::uint32_t>(remap.size());
+      remap.push_back(idx);
+    }
+    idx = newIndices[idx];
+  }
+
+  return remap;
+}
+
+namespace
+{
+
+// Symmetric 4x4 matrix of a sum of squared distances to planes, and the total area of those
+struct Quadric
+{
+  double a00, a01, a02, a03;
+  double a11, a12, a13;
+  double a22, a23;
+  double a33;
+  double weight;
+
+  static Quadric fromPlane(glm::vec3 n, float d, float weight)
+  {
+    const double x = n.x, y = n.y, z = n.z, w = d;
+    return Quadric{
+      weight * x * x, weight * x * y, weight * x * z, weight * x * w,
+      weight * y * y, weight * y * z, weight * y * w,
+      weight * z * z, weight * z * w,
+      weight * w * w,
+      weight};
+  }
+
+  Quadric& operator+=(const Quadric& o)
+  {
+    a00 += o.a00, a01 += o.a01, a02 += o.a02, a03 += o.a03;
+    a11 += o.a11, a12 += o.a12, a13 += o.a13;
+    a22 += o.a22, a23 += o.a23;
+    a33 += o.a33;
+    weight += o.weight;
+    return *this;
+  }
+
+  // Area-weighted mean squared distance from `p` to the planes
+  double error(glm::vec3 p) const
+  {
+    const double x = p.x, y = p.y, z = p.z;
+    const double sum = a00 * x * x + a11 * y * y + a22 * z * z + a33 +
+      2 * (a01 * x * y + a02 * x * z + a03 * x + a12 * y * z + a13 * y + a23 * z);
+    return weight > 0 ? std::max(sum, 0.0) / weight : 0.0;
+  }
+};
+
+struct PositionHash
+{
+  std::size_t operator()(const glm::vec3& p) const
+  {
+    std::size_t result = 0;
+    for (int i = 0; i < 3; ++i)
+      result = result * 0x9e3779b97f4a7c15ull + std::bit_cast<std::uint32_t>(p[i]);
+    return result;
+  }
+};
+
+// Compressed lists of items (vertices, triangles) per key, like in optimize_vertex_cache
+struct Adjacency
+{
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> items;
+
+  template <class GetKeys>
+  void build(std::size_t key_count, std::size_t item_count, std::size_t keys_per_item, GetKeys keys)
+  {
+    offsets.assign(key_count + 1, 0);
+    for (std::size_t i = 0; i < item_count; ++i)
+      for (std::size_t k = 0; k < keys_per_item; ++k)
+        ++offsets[keys(i, k) + 1];
+    for (std::size_t key = 0; key < key_count; ++key)
+      offsets[key + 1] += offsets[key];
+
+    items.resize(offsets.back());
+    std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < item_count; ++i)
+      for (std::size_t k = 0; k < keys_per_item; ++k)
+        items[fill[keys(i, k)]++] = static_cast<std::uint32_t>(i);
+  }
+
+  std::span<const std::uint32_t> operator[](std::size_t key) const
+  {
+    return std::span{items}.subspan(offsets[key], offsets[key + 1] - offsets[key]);
+  }
+};
+
+} // namespace
+
+SimplifyResult simplify(
+  std::span<const std::uint32_t> indices,
+  std::span<const glm::vec3> positions,
+  std::span<const glm::vec3> normals,
+  std::size_t target_index_count)
+{
+  // NOTE: a trailing incomplete triangle is dropped
+  indices = indices.first(indices.size() - indices.size() % 3);
+
+  SimplifyResult result{.indices = {indices.begin(), indices.end()}};
+  if (indices.size() <= target_index_count)
+    return result;
+
+  const std::size_t vertexCount = positions.size();
+
+  // Vertices with the same position form a class, represented by the first of them.
+  // Collapses move whole classes, otherwise attribute seams would be torn apart.
+  std::vector<std::uint32_t> vertexClass(vertexCount);
+  {
+    std::unordered_map<glm::vec3, std::uint32_t, PositionHash> firstVertex;
+    firstVertex.reserve(vertexCount);
+    for (std::uint32_t v = 0; v < vertexCount; ++v)
+    {
+      // NOTE: -0 == 0, but their bits are different
+      const glm::vec3 key = positions[v] + glm::vec3{0.0f};
+      vertexClass[v] = firstVertex.try_emplace(key, v).first->second;
+    }
+  }
+
+  Adjacency classVertices;
+  classVertices.build(vertexCount, vertexCount, 1, [&](std::size_t v, std::size_t) {
+    return vertexClass[v];
+  });
+
+  std::vector<Quadric> quadrics(vertexCount, Quadric{});
+  for (std::size_t t = 0; t < indices.size() / 3; ++t)
+  {
+    const glm::vec3& a = positions[indices[3 * t + 0]];
+    const glm::vec3& b = positions[indices[3 * t + 1]];
+    const glm::vec3& c = positions[indices[3 * t + 2]];
+    const glm::vec3 n = glm::cross(b - a, c - a);
+    const float len = glm::length(n);
+    if (len == 0)
+      continue;
+
+    const Quadric q = Quadric::fromPlane(n / len, -glm::dot(n / len, a), len / 2);
+    for (int k = 0; k < 3; ++k)
+      quadrics[vertexClass[indices[3 * t + k]]] += q;
+  }
+
+  // Classes on open borders or non-manifold edges are locked, as collapsing them
+  // would shrink holes and silhouettes of flat pieces.
+  std::vector<bool> locked(vertexCount, false);
+  {
+    std::unordered_map<std::uint64_t, std::uint32_t> edgeUses;
+    edgeUses.reserve(indices.size());
+    for (std::size_t i = 0; i < indices.size(); ++i)
+    {
+      const std::uint64_t a = vertexClass[indices[i]];
+      const std::uint64_t b = vertexClass[indices[i - i % 3 + (i + 1) % 3]];
+      if (a != b)
+        ++edgeUses[std::min(a, b) << 32 | std::max(a, b)];
+    }
+    for (const auto& [edge, uses] : edgeUses)
+      if (uses != 2)
+      {
+        locked[edge >> 32] = true;
+        locked[edge & 0xffffffff] = true;
+      }
+  }
+
+  struct Collapse
+  {
+    std::uint32_t from;
+    std::uint32_t to;
+    float error;
+  };
+
+  std::vector<Collapse> collapses;
+  std::vector<std::uint32_t> vertexRemap(vertexCount);
+  std::vector<bool> touched(vertexCount);
+  Adjacency classTriangles;
+
+  // Every pass collapses a batch of independent edges with the lowest errors
+  while (result.indices.size() > target_index_count)
+  {
+    auto& current = result.indices;
+    const std::size_t triCount = current.size() / 3;
+
+    collapses.clear();
+    for (std::size_t i = 0; i < current.size(); ++i)
+    {
+      const std::uint32_t from = vertexClass[current[i]];
+      const std::uint32_t to = vertexClass[current[i - i % 3 + (i + 1) % 3]];
+      if (locked[from])
+        continue;
+
+      Quadric q = quadrics[from];
+      q += quadrics[to];
+      collapses.push_back(Collapse{
+        .from = from,
+        .to = to,
+        .error = static_cast<float>(std::sqrt(q.error(positions[to]))),
+      });
+    }
+
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+      return a.error < b.error;
+    });
+
+    classTriangles.build(vertexCount, triCount, 3, [&](std::size_t t, std::size_t k) {
+      return vertexClass[current[3 * t + k]];
+    });
+
+    const auto flips = [&](const Collapse& collapse) {
+      for (const std::uint32_t t : classTriangles[collapse.from])
+      {
+        glm::vec3 oldCorners[3];
+        glm::vec3 newCorners[3];
+        bool degenerate = false;
+        for (int k = 0; k < 3; ++k)
+        {
+          const std::uint32_t cls = vertexClass[current[3 * t + k]];
+          degenerate |= cls == collapse.to;
+          oldCorners[k] = positions[cls];
+          newCorners[k] = cls == collapse.from ? positions[collapse.to] : positions[cls];
+        }
+        if (degenerate)
+          continue;
+
+        const glm::vec3 oldNormal =
+          glm::cross(oldCorners[1] - oldCorners[0], oldCorners[2] - oldCorners[0]);
+        const glm::vec3 newNormal =
+          glm::cross(newCorners[1] - newCorners[0], newCorners[2] - newCorners[0]);
+        if (glm::dot(oldNormal, newNormal) <= 0)
+          return true;
+      }
+      return false;
+    };
+
+    // Each vertex of `from` goes to the vertex of `to` with the closest normal
+    const auto closestVertex = [&](std::uint32_t v, std::uint32_t to) {
+      std::uint32_t best = to;
+      float bestDot = -std::numeric_limits<float>::infinity();
+      for (const std::uint32_t candidate : classVertices[to])
+      {
+        const float d = normals.empty() ? 0.0f : glm::dot(normals[v], normals[candidate]);
+        if (d > bestDot)
+        {
+          bestDot = d;
+          best = candidate;
+        }
+      }
+      return best;
+    };
+
+    for (std::uint32_t v = 0; v < vertexCount; ++v)
+      vertexRemap[v] = v;
+    std::fill(touched.begin(), touched.end(), false);
+
+    std::size_t trianglesToRemove = (current.size() - target_index_count + 2) / 3;
+    std::size_t collapsed = 0;
+    for (const Collapse& collapse : collapses)
+    {
+      if (trianglesToRemove == 0)
+        break;
+
+      // Triangles around a touched class are already changed, so skipping the collapse
+      // keeps the flip test valid and every vertex remapped at most once per pass.
+      if (touched[collapse.from] || touched[collapse.to] || flips(collapse))
+        continue;
+
+      for (const std::uint32_t v : classVertices[collapse.from])
+        vertexRemap[v] = closestVertex(v, collapse.to);
+      quadrics[collapse.to] += quadrics[collapse.from];
+      result.error = std::max(result.error, collapse.error);
+      ++collapsed;
+
+      for (const std::uint32_t t : classTriangles[collapse.from])
+      {
+        bool removed = false;
+        for (int k = 0; k < 3; ++k)
+        {
+          const std::uint32_t cls = vertexClass[current[3 * t + k]];
+          touched[cls] = true;
+          removed |= cls == collapse.to;
+        }
+        if (removed && trianglesToRemove > 0)
+          --trianglesToRemove;
+      }
+    }
+
+    if (collapsed == 0)
+      break;
+
+    std::size_t written = 0;
+    for (std::size_t t = 0; t < triCount; ++t)
+    {
+      const std::uint32_t a = vertexRemap[current[3 * t + 0]];
+      const std::uint32_t b = vertexRemap[current[3 * t + 1]];
+      const std::uint32_t c = vertexRemap[current[3 * t + 2]];
+      if (vertexClass[a] == vertexClass[b] || vertexClass[b] == vertexClass[c] ||
+          vertexClass[c] == vertexClass[a])
+        continue;
+      current[written++] = a;
+      current[written++] = b;
+      current[written++] = c;
+    }
+    current.resize(written);
+  }
+
+  return result;
+}
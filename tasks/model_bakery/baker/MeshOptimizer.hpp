@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Results of simulating a FIFO post-transform vertex cache. Raw counts are kept
+// so that stats of several meshes can be summed up.
+struct VertexCacheStats
+{
+  std::size_t triangles = 0;
+  std::size_t vertices = 0;
+  std::size_t transformed = 0;
+
+  // Average cache miss ratio, vertices transformed per triangle. 3 is the worst,
+  // about 0.5 is the best one can hope for on a regular grid.
+  float acmr() const { return triangles == 0 ? 0 : float(transformed) / float(triangles); }
+  // Average transform to vertex ratio, 1 means every vertex is transformed exactly once
+  float atvr() const { return vertices == 0 ? 0 : float(transformed) / float(vertices); }
+
+  VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+VertexCacheStats analyze_vertex_cache(
+  std::span<const std::uint32_t> indices, std::size_t vertex_count, std::uint32_t cache_size = 16);
+
+// Reorders triangles for post-transform vertex cache locality, see Tom Forsyth's
+// "Linear-Speed Vertex Cache Optimisation". Does not depend on the exact cache size.
+// Indices past the last whole triangle are not touched.
+void optimize_vertex_cache(std::span<std::uint32_t> indices, std::size_t vertex_count);
+
+// Reorders clusters of triangles produced by optimize_vertex_cache so that the ones
+// facing outwards are drawn first and occlude the rest, like in Sander et al.
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+// The new order is only kept if ACMR gets no worse than `threshold` times the current one.
+void optimize_overdraw(
+  std::span<std::uint32_t> indices, std::span<const glm::vec3> positions, float threshold);
+
+// Rewrites `indices` so that vertices are numbered in the order of first use,
+// returns the old index of every new vertex. Unused vertices are dropped.
+std::vector<std::uint32_t> optimize_vertex_fetch_remap(
+  std::span<std::uint32_t> indices, std::size_t vertex_count);
+
+struct SimplifyResult
+{
+  std::vector<std::uint32_t> indices;
+  // Distance between the simplified surface and the original one, estimated from quadrics
+  float error = 0;
+};
+
+// Reduces the triangle count to about `target_index_count / 3` with quadric error metric
+// edge collapses (Garland & Heckbert). Vertices are only ever collapsed onto their
+// neighbours, so the result indexes a subset of the original vertices and LODs can
+// share the vertex buffer. Vertices with equal positions are collapsed together,
+// `normals` are used to pick matching vertices on attribute seams and may be empty.
+// Open borders are never collapsed, so the result has no new cracks.
+// Indices past the last whole triangle are dropped from the result.
+SimplifyResult simplify(
+  std::span<const std::uint32_t> indices,
+  std::span<const glm::vec3> positions,
+  std::span<const glm::vec3> normals,
+  std::size_t target_index_count);
+
+// Reorders vertices in the order they are fetched in, see optimize_vertex_fetch_remap
+template <class Vertex>
+void optimize_vertex_fetch(std::span<std::uint32_t> indices, std::vector<Vertex>& vertices)
+{
+  const auto remap = optimize_vertex_fetch_remap(indices, vertices.size());
+
+  std::vector<Vertex> result;
+  result.reserve(remap.size());
+  for (const std::uint32_t oldIdx : remap)
+    result.push_back(vertices[oldIdx]);
+
+  vertices = std::move(result);
+}
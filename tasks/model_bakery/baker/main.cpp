@@ -1,4 +1,43 @@
-int main()
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+#include "Baker.hpp"
+
+
+int main(int argc, char** argv)
 {
-  return 0;
+  BakeOptions options;
+  const char* path = nullptr;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--no-optimize")
+    {
+      options.optimizeVertexCache = false;
+      options.optimizeVertexFetch = false;
+    }
+    else if (arg == "--overdraw")
+      options.optimizeOverdraw = true;
+    else if (arg == "--lods" && i + 1 < argc)
+      options.maxLodCount = static_cast<std::uint32_t>(std::max(1, std::atoi(argv[++i])));
+    else if (path == nullptr && !arg.starts_with("--"))
+      path = argv[i];
+    else
+    {
+      path = nullptr;
+      break;
+    }
+  }
+
+  if (path == nullptr)
+  {
+    std::cerr << "Usage: " << argv[0]
+              << " [--no-optimize] [--overdraw] [--lods <count>] <path to scene.gltf>\n";
+    return 1;
+  }
+
+  return bake_scene(path, options) ? 0 : 1;
 }
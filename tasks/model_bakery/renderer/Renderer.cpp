@@ -1,9 +1,11 @@
 #include "Renderer.hpp"
 
+#include <array>
+#include <cstdlib>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
 #include <etna/RenderTargetStates.hpp>
-#include <etna/PipelineManager.hpp>
 #include <etna/Profiling.hpp>
 
 
@@ -53,10 +55,20 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   resolution = {w, h};
 
-  worldRenderer = std::make_unique<WorldRenderer>();
+  pipelineCache = std::make_unique<PersistentPipelineCache>("model_bakery_pipeline_cache.bin");
+  pipelineBuilder = std::make_unique<PipelineBuilder>(pipelineCache->get());
+
+  worldRenderer = std::make_unique<WorldRenderer>(*pipelineBuilder);
+
+  std::filesystem::path shadersRoot = MODEL_BAKERY_RENDERER_SHADERS_ROOT;
+#ifdef SHADER_HOT_RELOAD
+  const std::array shaderDirs{shadersRoot};
+  shaderReloader = std::make_unique<ShaderHotReloader>(shaderDirs);
+  shadersRoot = shaderReloader->getLoadDirectory(shadersRoot);
+#endif
 
   worldRenderer->allocateResources(resolution);
-  worldRenderer->loadShaders();
+  worldRenderer->loadShaders(shadersRoot);
   worldRenderer->setupPipelines(window->getCurrentFormat());
 }
 
@@ -69,6 +81,10 @@ void Renderer::debugInput(const Keyboard& kb)
 {
   worldRenderer->debugInput(kb);
 
+#ifdef SHADER_HOT_RELOAD
+  if (kb[KeyboardKey::kB] == ButtonState::Falling && shaderReloader)
+    shaderReloader->recompileAll();
+#else
   if (kb[KeyboardKey::kB] == ButtonState::Falling)
   {
     const int retval = std::system("cd " GRAPHICS_COURSE_ROOT "/build"
@@ -76,12 +92,20 @@ void Renderer::debugInput(const Keyboard& kb)
     if (retval != 0)
       spdlog::warn("Shader recompilation returned a non-zero return code!");
     else
-    {
-      ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
-      etna::reload_shaders();
-      spdlog::info("Successfully reloaded shaders!");
-    }
+      reloadShaders();
   }
+#endif
+}
+
+void Renderer::reloadShaders()
+{
+  // NOTE: etna replaces the shader modules and layouts of programs in place, so the
+  // builder must be done with the old ones. The frames in flight only need the old
+  // pipeline, which setupPipelines retires.
+  pipelineBuilder->waitIdle();
+  etna::reload_shaders();
+  worldRenderer->setupPipelines(window->getCurrentFormat());
+  spdlog::info("Successfully reloaded shaders!");
 }
 
 void Renderer::update(const FramePacket& packet)
@@ -93,7 +117,13 @@ void Renderer::drawFrame()
 {
   ZoneScoped;
 
+#ifdef SHADER_HOT_RELOAD
+  if (shaderReloader)
+    shaderReloader->applyRecompiled([this]() { reloadShaders(); });
+#endif
+
   auto currentCmdBuf = commandManager->acquireNext();
+  pipelineBuilder->beginFrame();
 
   etna::begin_frame();
 
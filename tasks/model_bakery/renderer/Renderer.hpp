@@ -5,6 +5,11 @@
 #include <glm/glm.hpp>
 #include <function2/function2.hpp>
 
+#include "render_utils/PersistentPipelineCache.hpp"
+#include "render_utils/PipelineBuilder.hpp"
+#ifdef SHADER_HOT_RELOAD
+#include "render_utils/ShaderHotReloader.hpp"
+#endif
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -28,14 +33,25 @@ public:
   void update(const FramePacket& packet);
   void drawFrame();
 
+private:
+  // Reloads the SPIR-V of every program and registers their pipelines again
+  void reloadShaders();
+
 private:
   ResolutionProvider resolutionProvider;
 
   std::unique_ptr<etna::Window> window;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
+#ifdef SHADER_HOT_RELOAD
+  std::unique_ptr<ShaderHotReloader> shaderReloader;
+#endif
 
   glm::uvec2 resolution;
   bool useVsync = true;
 
+  std::unique_ptr<PersistentPipelineCache> pipelineCache;
+  // Declared after the cache, so that it is destroyed before it
+  std::unique_ptr<PipelineBuilder> pipelineBuilder;
+
   std::unique_ptr<WorldRenderer> worldRenderer;
 };
@@ -1,14 +1,17 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <utility>
+
 #include <etna/GlobalContext.hpp>
-#include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
 
 
-WorldRenderer::WorldRenderer()
-  : sceneMgr{std::make_unique<SceneManager>()}
+WorldRenderer::WorldRenderer(PipelineBuilder& pipeline_builder)
+  : pipelineBuilder{pipeline_builder}
+  , sceneMgr{std::make_unique<SceneManager>()}
 {
 }
 
@@ -28,46 +31,37 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScene(path);
+  // NOTE: the scene has to be baked with model_bakery_baker beforehand
+  sceneMgr->selectBakedSceneAsync(path);
 }
 
-void WorldRenderer::loadShaders()
+void WorldRenderer::loadShaders(const std::filesystem::path& shaders_root)
 {
   etna::create_program(
     "static_mesh_material",
-    {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
-     MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
-  etna::create_program("static_mesh", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
+    {shaders_root / "static_mesh.frag.spv", shaders_root / "static_mesh.vert.spv"});
+  etna::create_program("static_mesh", {shaders_root / "static_mesh.vert.spv"});
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
-  etna::VertexShaderInputDescription sceneVertexInputDesc{
-    .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
-    }},
-  };
-
-  auto& pipelineManager = etna::get_context().getPipelineManager();
-
-  staticMeshPipeline = {};
-  staticMeshPipeline = pipelineManager.createGraphicsPipeline(
-    "static_mesh_material",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
+  // NOTE: frames in flight may still be using the old pipeline
+  pipelineBuilder.retire(std::exchange(
+    staticMeshPipeline,
+    pipelineBuilder.buildGraphics(
+      "static_mesh_material",
+      PipelineBuilder::GraphicsPipelineInfo{
+        .vertexInput = sceneMgr->getBakedVertexFormatDescription(),
+        .rasterizationConfig =
+          vk::PipelineRasterizationStateCreateInfo{
+            .polygonMode = vk::PolygonMode::eFill,
+            .cullMode = vk::CullModeFlagBits::eBack,
+            .frontFace = vk::FrontFace::eCounterClockwise,
+            .lineWidth = 1.f,
+          },
+        .colorAttachmentFormats = {swapchain_format},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      })));
 }
 
 void WorldRenderer::debugInput(const Keyboard&) {}
@@ -76,15 +70,51 @@ void WorldRenderer::update(const FramePacket& packet)
 {
   ZoneScoped;
 
+  // This is the frame boundary, so a freshly loaded scene may be swapped in here
+  sceneMgr->update();
+
   // calc camera matrix
   {
     const float aspect = float(resolution.x) / float(resolution.y);
     worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
   }
+
+  // Instances outside of a view are skipped when recording its draws
+  {
+    ZoneScopedN("cullInstances");
+
+    const auto& spheres = sceneMgr->getInstanceBoundingSpheres();
+    cull_spheres(spheres, extract_frustum_planes(worldViewProj), mainViewVisible);
+  }
+
+  // LODs are selected by the size of a mesh-space unit on the screen in pixels,
+  // measured at the point of the bounding sphere closest to the camera.
+  {
+    const auto instanceMatrices = sceneMgr->getInstanceMatrices();
+    const auto& spheres = sceneMgr->getInstanceBoundingSpheres();
+    const float pixelsPerUnit =
+      float(resolution.y) / (2.0f * std::tan(glm::radians(packet.mainCam.fov) / 2.0f));
+
+    instanceLodScales.resize(instanceMatrices.size());
+    for (const std::uint32_t i : mainViewVisible)
+    {
+      const auto& m = instanceMatrices[i];
+      const float scale = std::max(
+        {glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+      const glm::vec3 center{spheres.x[i], spheres.y[i], spheres.z[i]};
+      const float distance = std::max(
+        glm::distance(center, packet.mainCam.position) - spheres.radius[i],
+        packet.mainCam.zNear);
+      instanceLodScales[i] = pixelsPerUnit * scale / distance;
+    }
+  }
 }
 
 void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout,
+  std::span<const std::uint32_t> visible_instances)
 {
   if (!sceneMgr->getVertexBuffer())
     return;
@@ -99,8 +129,9 @@ void WorldRenderer::renderScene(
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
+  auto lods = sceneMgr->getRenderElementLods();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  for (const std::uint32_t instIdx : visible_instances)
   {
     pushConst2M.model = instanceMatrices[instIdx];
 
@@ -113,7 +144,16 @@ void WorldRenderer::renderScene(
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+
+      // The coarsest LOD that is indistinguishable from the original one
+      const auto relemLods = lods.subspan(relem.firstLod, relem.lodCount);
+      std::size_t lodIdx = 0;
+      while (lodIdx + 1 < relemLods.size() &&
+             relemLods[lodIdx + 1].error * instanceLodScales[instIdx] <= lodErrorThreshold)
+        ++lodIdx;
+
+      const auto& lod = relemLods[lodIdx];
+      cmd_buf.drawIndexed(lod.indexCount, 1, lod.indexOffset, relem.vertexOffset, 0);
     }
   }
 }
@@ -134,6 +174,7 @@ void WorldRenderer::renderWorld(
       {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
 
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, staticMeshPipeline.getVkPipeline());
-    renderScene(cmd_buf, worldViewProj, staticMeshPipeline.getVkPipelineLayout());
+    renderScene(
+      cmd_buf, worldViewProj, staticMeshPipeline.getVkPipelineLayout(), mainViewVisible);
   }
 }
@@ -3,10 +3,10 @@
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
-#include <etna/GraphicsPipeline.hpp>
 #include <glm/glm.hpp>
 
 #include "scene/SceneManager.hpp"
+#include "render_utils/PipelineBuilder.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -15,11 +15,12 @@
 class WorldRenderer
 {
 public:
-  WorldRenderer();
+  explicit WorldRenderer(PipelineBuilder& pipeline_builder);
 
   void loadScene(std::filesystem::path path);
 
-  void loadShaders();
+  // Loads the SPIR-V from `shaders_root`, the build output or its hot reload copy
+  void loadShaders(const std::filesystem::path& shaders_root);
   void allocateResources(glm::uvec2 swapchain_resolution);
   void setupPipelines(vk::Format swapchain_format);
 
@@ -31,10 +32,14 @@ public:
 
 private:
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout,
+    std::span<const std::uint32_t> visible_instances);
 
 
 private:
+  PipelineBuilder& pipelineBuilder;
   std::unique_ptr<SceneManager> sceneMgr;
 
   etna::Image mainViewDepth;
@@ -47,9 +52,16 @@ private:
   } pushConst2M;
 
   glm::mat4x4 worldViewProj;
-  glm::mat4x4 lightMatrix;
 
-  etna::GraphicsPipeline staticMeshPipeline{};
+  // Indices of instances which intersect the view frustum, updated every frame
+  std::vector<std::uint32_t> mainViewVisible;
+
+  // Pixels per mesh-space unit for every visible instance, updated every frame
+  std::vector<float> instanceLodScales;
+  // Max LOD error on the screen in pixels
+  float lodErrorThreshold = 1.0f;
+
+  AsyncPipeline staticMeshPipeline;
 
   glm::uvec2 resolution;
 };
@@ -2,11 +2,13 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
 
-#include "unpack_attributes.glsl"
 
-
-layout(location = 0) in vec4 vPosNorm;
-layout(location = 1) in vec4 vTexCoordAndTang;
+// See BakedVertex in scene/BakedSceneFormat.hpp,
+// normals and tangents are unpacked from snorm8 by the hardware
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec4 vNorm;
+layout(location = 2) in vec2 vTexCoord;
+layout(location = 3) in vec4 vTang;
 
 layout(push_constant) uniform params_t
 {
@@ -27,13 +29,10 @@ out gl_PerVertex { vec4 gl_Position; };
 
 void main(void)
 {
-  const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
-  const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
-
-  vOut.wPos   = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm  = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
-  vOut.texCoord = vTexCoordAndTang.xy;
+  vOut.wPos   = (params.mModel * vec4(vPos, 1.0f)).xyz;
+  vOut.wNorm  = normalize(mat3(transpose(inverse(params.mModel))) * vNorm.xyz);
+  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * vTang.xyz);
+  vOut.texCoord = vTexCoord;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
 }